@@ -28,6 +28,138 @@ _main:
 ret
 )"};
 
+// Чистая функция с циклом мемоизируется. Значения, положенные ей в стек и
+// снятые, видны через mov sp и при втором вызове (из таблицы): результат тот
+// же, что и при сборке с -DVCAI_MEMO_SIZE=0
+constexpr auto memo_prog{R"(
+fn:
+    mov r1 0
+fn_loop:
+    inc r1
+    push r1
+    pop r2
+    cmp r1 4
+    jle fn_loop
+ret
+
+main:
+    call fn
+    mov sp 0
+    push 100
+    mov sp 0
+    call fn
+    mov sp 1
+    mov r0 &r3
+ret
+)"};
+static_assert(vcai::exec_fn(memo_prog) == 5);
+static_assert(VCAI_MEMO_SIZE == 0 or
+              vcai::exec_full(memo_prog).MemoHits == 1);
+
+// Остаточная программа для известной части входных данных даёт тот же
+// результат, что и исходная, за steps инструкций
+constexpr auto specialized(const char *txt, const vcai::KnownInput &known,
+                           const vcai::Input &input, vcai::size &steps)
+    -> bool {
+    vcai::Program prog{txt};
+    auto text{vcai::specialize(prog, known)};
+    vcai::Program residual{text.c_str()};
+    steps = vcai::exec_full(residual, input).Steps;
+
+    return vcai::check_residual(prog, residual, input);
+}
+
+// Цикл с известной границей a0 разворачивается, ветвление по неизвестному
+// a1 остаётся в остаточной программе
+constexpr auto loop_prog{R"(
+main:
+    mov r1 0
+loop:
+    cmp r1 a0
+    jge _loop
+    cmp a1 r1
+    jl skip
+    add r0 r1
+skip:
+    inc r1
+    jmp loop
+_loop:
+ret
+)"};
+static_assert([] {
+    vcai::KnownInput known{};
+    known.ArgKnown[0] = true;
+    known.Values.ArgReg[0] = 5;
+    for (vcai::i64 val{-1}; val <= 5; ++val) {
+        auto input{known.Values};
+        input.ArgReg[1] = val;
+        vcai::size steps{};
+        if (not specialized(loop_prog, known, input, steps)) return false;
+        vcai::Program prog{loop_prog};
+        if (steps >= vcai::exec_full(prog, input).Steps) return false;
+    }
+    return true;
+}());
+
+// Ветвление по неизвестному a1: обе ветви специализируются для известного a0
+constexpr auto branch_prog{R"(
+main:
+    mov r0 a0
+    mul r0 a0
+    cmp a1 0
+    jl neg
+    add r0 a1
+ret
+neg:
+    sub r0 a1
+    mul r0 2
+ret
+)"};
+static_assert([] {
+    vcai::KnownInput known{};
+    known.ArgKnown[0] = true;
+    known.Values.ArgReg[0] = 7;
+    for (vcai::i64 val{-2}; val <= 2; ++val) {
+        auto input{known.Values};
+        input.ArgReg[1] = val;
+        vcai::size steps{};
+        if (not specialized(branch_prog, known, input, steps)) return false;
+    }
+    return true;
+}());
+
+// Известная часть стека: сумма элементов по индексам и запись через mov sp
+constexpr auto stack_prog{R"(
+main:
+    mov r1 0
+loop:
+    cmp r1 sp
+    je _loop
+    add r0 &r1
+    inc r1
+    jmp loop
+_loop:
+    mov r2 sp
+    mov sp a0
+    push r0
+    mov sp r2
+ret
+)"};
+static_assert([] {
+    vcai::KnownInput known{};
+    known.Values.SP = 4;
+    known.StackKnown = 2;
+    for (vcai::size ind{}; ind < 4; ++ind)
+        known.Values.Stack[ind] = static_cast<vcai::i64>(ind) * 3;
+    for (vcai::i64 addr{}; addr < 6; ++addr) {
+        auto input{known.Values};
+        input.ArgReg[0] = addr;
+        vcai::size steps{};
+        if (not specialized(stack_prog, known, input, steps)) return false;
+    }
+    return true;
+}());
+
 auto main() -> int {
     constexpr auto res{vcai::exec_fn(prog)};
 
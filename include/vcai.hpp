@@ -11,6 +11,11 @@ Valetoriy Constexpr ASM Interpreter
 (c) shadolproff @ github.com/Valetoriy
 */
 
+// Векторные операции в рантайме используют AVX2, если он доступен
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
 namespace vcai {
 
 static_assert(sizeof(long) == 8,  // NOLINT magic numbers
@@ -22,6 +27,27 @@ static_assert(
     "Для size нужен 8-байтный целочисленный положительный тип данных!");
 using size = unsigned long;
 
+// Количество 64-битных элементов в векторном регистре
+inline constexpr size VLANES{4};
+// Размер стека интерпретатора
+inline constexpr size STACKSIZE{128};
+
+// Трассировка выполнения включается макросом VCAI_TRACE, размер кольцевого
+// буфера событий задаётся макросом VCAI_TRACE_SIZE
+#if !defined(VCAI_TRACE_SIZE)
+#define VCAI_TRACE_SIZE 4096  // NOLINT macro
+#endif
+inline constexpr size TRACESIZE{VCAI_TRACE_SIZE};
+
+// Размер таблицы мемоизации вызовов чистых функций задаётся макросом
+// VCAI_MEMO_SIZE, 0 - мемоизация отключена
+#if !defined(VCAI_MEMO_SIZE)
+#define VCAI_MEMO_SIZE 256  // NOLINT macro
+#endif
+inline constexpr size MEMOSIZE{VCAI_MEMO_SIZE};
+// Регистры в масках мемоизации: биты 0-3 - r0-r3, 4-7 - a0-a3, 8 - ZF, 9 - SF
+inline constexpr size MEMOREGS{10};
+
 [[nodiscard]] constexpr auto strlen(const char *str) noexcept -> size {
     size len{};
     while (str[len] != 0) ++len;
@@ -109,7 +135,9 @@ struct DynamicArray {
 
     constexpr auto clear() noexcept -> void { m_size = 0; }
 
-    constexpr auto is_empty() noexcept -> bool { return m_size == 0; }
+    [[nodiscard]] constexpr auto is_empty() const noexcept -> bool {
+        return m_size == 0;
+    }
 
     [[nodiscard]] constexpr auto size() const noexcept { return m_size; }
     [[nodiscard]] constexpr auto capacity() const noexcept {
@@ -121,7 +149,7 @@ struct DynamicArray {
         return data[ind];
     }
     [[nodiscard]] constexpr auto operator[](
-        const vcai::size &ind) const noexcept -> auto & {
+        const vcai::size &ind) const noexcept -> const auto & {
         return data[ind];
     }
 
@@ -208,6 +236,24 @@ struct DynamicArray {
 template <typename Elem1, typename... Elems>
 DynamicArray(Elem1, Elems...) -> DynamicArray<Elem1>;
 
+// Названия функций ЯП-а, порядок совпадает с Op
+inline constexpr StaticArray FUNCS{
+    "add",  "sub",  "mul",  "div",  "mod",  "cmp",  "mov",  "shl",
+    "shr",  "xor",  "and",  "or",   "inc",  "dec",  "jmp",  "jl",
+    "je",   "jne",  "jg",   "jle",  "jge",  "call", "push", "pop",
+    "ret",  "vadd", "vsub", "vmul", "vxor", "vand", "vor",  "vshl",
+    "vshr", "vbrd", "vsum", "vld",  "vst",  "vpush", "vpop"};
+
+enum class Op : unsigned char {
+    add, sub, mul, div, mod, cmp, mov, shl,
+    shr, v_xor, v_and, v_or, inc, dec, jmp, jl,
+    je, jne, jg, jle, jge, call, push, pop,
+    ret, vadd, vsub, vmul, vxor, vand, vor, vshl,
+    vshr, vbrd, vsum, vld, vst, vpush, vpop,
+    // Слово не является функцией
+    none
+};
+
 template <typename CharType>
 struct BasicString {
     constexpr auto push_back(const CharType &elem) noexcept -> void {
@@ -225,6 +271,22 @@ struct BasicString {
         if (m_size > 0) --m_size;
     }
 
+    constexpr auto append(const CharType *str) noexcept -> void {
+        for (; *str != 0; ++str) push_back(*str);
+    }
+
+    constexpr auto append(const BasicString &other) noexcept -> void {
+        for (vcai::size ind{}; ind < other.m_size; ++ind)
+            push_back(other.data[ind]);
+    }
+
+    // Указатель на строку с завершающим нулём
+    [[nodiscard]] constexpr auto c_str() noexcept -> const CharType * {
+        reserve(m_size + 1);
+        data[m_size] = 0;
+        return data;
+    }
+
     [[nodiscard]] constexpr auto front() noexcept -> auto & { return data[0]; }
     [[nodiscard]] constexpr auto front() const noexcept -> auto & {
         return data[0];
@@ -237,16 +299,11 @@ struct BasicString {
         return data[m_size - 1];
     }
 
-    [[nodiscard]] constexpr auto is_func() const noexcept -> bool {
-        StaticArray funcs{"add",  "sub",  "mul", "div", "mod", "cmp", "mov",
-                          "shl",  "shr",  "xor", "and", "or",  "inc", "dec",
-                          "jmp",  "jl",   "je",  "jne", "jg",  "jle", "jge",
-                          "call", "push", "pop", "ret"};
-
-        for (vcai::size ind{}; ind < funcs.size(); ++ind)
-            if (*this == funcs[ind]) return true;
+    // Индекс в FUNCS, -1 - слово не является функцией
+    [[nodiscard]] constexpr auto func_id() const noexcept -> i64;
 
-        return false;
+    [[nodiscard]] constexpr auto is_func() const noexcept -> bool {
+        return func_id() != -1;
     }
 
     [[nodiscard]] constexpr auto is_i64() const noexcept -> bool {
@@ -302,7 +359,9 @@ struct BasicString {
 
     constexpr auto clear() noexcept -> void { m_size = 0; }
 
-    constexpr auto is_empty() noexcept -> bool { return m_size == 0; }
+    [[nodiscard]] constexpr auto is_empty() const noexcept -> bool {
+        return m_size == 0;
+    }
 
     [[nodiscard]] constexpr auto size() const noexcept { return m_size; }
     [[nodiscard]] constexpr auto capacity() const noexcept {
@@ -411,6 +470,34 @@ struct BasicString {
 
 using String = BasicString<char>;
 
+[[nodiscard]] constexpr auto to_string(const i64 &num) noexcept -> String {
+    String str;
+    // Цифры в обратном порядке, отрицательные числа не переполняются
+    i64 rest{num};
+    do {
+        auto digit{rest % 10};  // NOLINT magic numbers
+        str.push_back(static_cast<char>('0' + (digit < 0 ? -digit : digit)));
+        rest /= 10;  // NOLINT magic numbers
+    } while (rest != 0);
+    if (num < 0) str.push_back('-');
+
+    for (vcai::size ind{}; ind < str.size() / 2; ++ind) {
+        auto chr{str[ind]};
+        str[ind] = str[str.size() - 1 - ind];
+        str[str.size() - 1 - ind] = chr;
+    }
+
+    return str;
+}
+
+template <typename CharType>
+constexpr auto BasicString<CharType>::func_id() const noexcept -> i64 {
+    for (vcai::size ind{}; ind < FUNCS.size(); ++ind)
+        if (*this == FUNCS[ind]) return static_cast<i64>(ind);
+
+    return -1;
+}
+
 template <typename Key, typename Value, vcai::size Size>
 struct StaticMap {
     [[nodiscard]] constexpr auto size() const noexcept { return Size; }
@@ -515,24 +602,769 @@ struct DynamicMap {
     vcai::size m_capacity{};
 };
 
+static_assert(sizeof(unsigned int) == 4,  // NOLINT magic numbers
+              "Для u32 нужен 4-байтный целочисленный тип данных!");
+using u32 = unsigned int;
+
+// Событие трассировки - одна выполненная инструкция
+struct TraceEvent {
+    // Биты Flags
+    static constexpr unsigned char ZFBIT{1}, SFBIT{2};
+
+    u32 PC;
+    // Глубина CallStack перед выполнением инструкции
+    unsigned short Depth;
+    // Значение из Op
+    unsigned char Opcode;
+    // ZF/SF после выполнения инструкции
+    unsigned char Flags;
+    // Значение первого аргумента после выполнения инструкции
+    i64 Dst;
+};
+
+// Кольцевой буфер последних TRACESIZE событий
+struct Trace {
+    constexpr auto push_back(const TraceEvent &event) noexcept -> void {
+        Events[Count % TRACESIZE] = event;
+        ++Count;
+    }
+
+    [[nodiscard]] constexpr auto size() const noexcept -> vcai::size {
+        return Count < TRACESIZE ? Count : TRACESIZE;
+    }
+
+    // Количество вытесненных из буфера событий
+    [[nodiscard]] constexpr auto dropped() const noexcept -> vcai::size {
+        return Count - size();
+    }
+
+    // События в порядке выполнения, начиная с самого старого
+    [[nodiscard]] constexpr auto operator[](
+        const vcai::size &ind) const noexcept -> auto & {
+        return Events[(dropped() + ind) % TRACESIZE];
+    }
+
+    StaticArray<TraceEvent, TRACESIZE> Events{};
+    vcai::size Count{};
+};
+
+// Результаты анализа трассировки
+struct TraceStats {
+    // Выполненный обратный переход From -> To
+    struct Loop {
+        i64 From, To;
+        vcai::size Count;
+    };
+    // Условный переход
+    struct Branch {
+        i64 PC;
+        vcai::size Taken, Total;
+    };
+
+    // По убыванию Count
+    DynamicArray<Loop> Loops;
+    // По возрастанию PC
+    DynamicArray<Branch> Branches;
+    // Depths[d] - количество инструкций, выполненных на глубине CallStack d
+    DynamicArray<vcai::size> Depths;
+};
+
+[[nodiscard]] constexpr auto analyze_trace(const Trace &trace) noexcept
+    -> TraceStats {
+    TraceStats stats;
+    const auto len{trace.size()};
+    for (vcai::size ind{}; ind < len; ++ind) {
+        const auto &event{trace[ind]};
+
+        while (stats.Depths.size() <= event.Depth) stats.Depths.push_back(0);
+        ++stats.Depths[event.Depth];
+
+        // Для последнего события неизвестно, был ли выполнен переход
+        if (ind + 1 == len) break;
+
+        auto opcode{static_cast<Op>(event.Opcode)};
+        if (opcode < Op::jmp or opcode > Op::jge) continue;
+
+        auto from{static_cast<i64>(event.PC)};
+        auto to{static_cast<i64>(trace[ind + 1].PC)};
+        bool taken{to != from + 1};
+
+        if (opcode != Op::jmp) {
+            vcai::size bind{};
+            while (bind < stats.Branches.size() and
+                   stats.Branches[bind].PC < from)
+                ++bind;
+            if (bind == stats.Branches.size() or
+                stats.Branches[bind].PC != from) {
+                stats.Branches.push_back({});
+                for (auto mind{stats.Branches.size() - 1}; mind > bind; --mind)
+                    stats.Branches[mind] = stats.Branches[mind - 1];
+                stats.Branches[bind] = {from, 0, 0};
+            }
+            ++stats.Branches[bind].Total;
+            if (taken) ++stats.Branches[bind].Taken;
+        }
+
+        if (taken and to <= from) {
+            vcai::size lind{};
+            while (lind < stats.Loops.size() and
+                   (stats.Loops[lind].From != from or
+                    stats.Loops[lind].To != to))
+                ++lind;
+            if (lind == stats.Loops.size())
+                stats.Loops.push_back({from, to, 0});
+            ++stats.Loops[lind].Count;
+        }
+    }
+
+    // Сортировка вставками по убыванию Count
+    for (vcai::size ind{1}; ind < stats.Loops.size(); ++ind) {
+        auto loop{stats.Loops[ind]};
+        auto mind{ind};
+        for (; mind > 0 and stats.Loops[mind - 1].Count < loop.Count; --mind)
+            stats.Loops[mind] = stats.Loops[mind - 1];
+        stats.Loops[mind] = loop;
+    }
+
+    return stats;
+}
+
+// Входные данные программы
+struct Input {
+    StaticArray<i64, 4> ArgReg{};
+    // Начальное содержимое стека - первые SP элементов
+    StaticArray<i64, STACKSIZE> Stack{};
+    i64 SP{};
+};
+
+// Состояние интерпретатора после завершения программы
+struct ExecResult {
+    StaticArray<i64, 4> IntReg{};
+    StaticArray<i64, 4> ArgReg{};
+    StaticArray<StaticArray<i64, VLANES>, 4> VecReg{};
+    i64 SP{};
+    // Значимы только первые SP элементов, остальные обнулены. При SP <= 0
+    // стек пуст, при SP > STACKSIZE содержит весь стек
+    StaticArray<i64, STACKSIZE> Stack{};
+    // Количество выполненных инструкций (вызов с результатом из таблицы
+    // мемоизации - одна инструкция)
+    size Steps{};
+    // Попадания и промахи таблицы мемоизации
+    size MemoHits{}, MemoMisses{};
+#if defined(VCAI_TRACE)
+    Trace Tracer{};
+#endif
+};
+
+// Аргумент инструкции после декодирования
+struct Operand {
+    enum class Kind : unsigned char {
+        none,      // Неизвестное слово
+        ir,        // r0-3, Value - номер регистра
+        ar,        // a0-3, Value - номер регистра
+        vr,        // v0-3, Value - номер регистра
+        sp,        // SP
+        stack_ir,  // &r0-3, Value - номер регистра с индексом в стеке
+        stack_ar,  // &a0-3, Value - номер регистра с индексом в стеке
+        label,     // Ярлык, Value - адрес
+        imm        // Целочисленная константа, Value - значение
+    };
+
+    Kind Type{};
+    i64 Value{};
+};
+
+struct Instr {
+    Op Code{Op::none};
+    // Для call чистой функции: регистры, от которых зависит результат, и
+    // регистры, которые функция может изменить (см. Program::AnalyzeCalls).
+    // MemoOut == 0 - вызов не мемоизируется
+    unsigned short MemoKey{}, MemoOut{};
+    // Количество аргументов (может быть больше 3 при синтаксической ошибке)
+    size Argc{};
+    StaticArray<Operand, 3> Args{};
+};
+
+// Допустимо ли количество аргументов функции
+[[nodiscard]] constexpr auto valid_argc(Op func, size argc) noexcept -> bool {
+    if (argc == 3)
+        return func <= Op::mod or (func >= Op::vadd and func <= Op::vmul);
+    if (argc == 2)
+        return func <= Op::v_or or (func >= Op::vadd and func <= Op::vst);
+    return (func >= Op::inc and func <= Op::pop) or func == Op::vpush or
+           func == Op::vpop;
+}
+
+// Разобранная и декодированная программа. После загрузки через Load() не
+// изменяется, поэтому может одновременно выполняться несколькими
+// интерпретаторами. Программа, загруженная через LoadLazy(), декодирует
+// инструкции при первом обращении, изменяя Code и Decoded, поэтому
+// выполняется только в одном потоке и не может быть const-объектом
+struct Program {
+    // При ленивой загрузке недекодированные инструкции - Instr{}
+    DynamicArray<Instr> Code;
+    DynamicMap<String, i64> Labels;
+    // Адрес main, -1 - main отсутствует
+    i64 Entry{-1};
+
+    // Ленивая загрузка: границы строк инструкций в тексте программы
+    struct Line {
+        size Begin, End;
+    };
+    const char *Text{};
+    DynamicArray<Line> Lines;
+    DynamicArray<bool> Decoded;
+
+    constexpr auto Load(const char *txt) noexcept -> void {
+        DynamicArray<DynamicArray<String>> prog;
+        ToWordArray(txt, vcai::strlen(txt), prog);
+
+        Code.reserve(prog.size());
+        for (const auto &line : prog) Code.push_back(Decode(line));
+        AnalyzeCalls();
+    }
+
+    // Ленивая загрузка для программ с большими библиотеками функций: текст
+    // разбивается на строки и ярлыки, декодируются только инструкции,
+    // достижимые из main (следующая инструкция и ярлыки в аргументах), прочие -
+    // при первом выполнении (вызовы в них не мемоизируются). txt должен
+    // существовать, пока используется программа
+    constexpr auto LoadLazy(const char *txt) noexcept -> void {
+        Text = txt;
+        IndexLines(txt, vcai::strlen(txt));
+        for (size ind{}; ind < Lines.size(); ++ind) {
+            Code.push_back({});
+            Decoded.push_back(false);
+        }
+
+        DynamicArray<i64> work;
+        if (Entry != -1) work.push_back(Entry);
+        while (not work.is_empty()) {
+            auto addr{work.back()};
+            work.pop_back();
+            if (addr < 0 or addr >= static_cast<i64>(Lines.size()) or
+                Decoded[static_cast<size>(addr)])
+                continue;
+
+            const auto &instr{Fetch(static_cast<size>(addr))};
+            // Адреса в константах возможны только у переходов и call,
+            // ярлыки - в любом аргументе (вычисляемые переходы)
+            bool branch{instr.Code >= Op::jmp and instr.Code <= Op::call};
+            for (size aind{}; aind < instr.Argc and aind < 3; ++aind) {
+                const auto &arg{instr.Args[aind]};
+                if (arg.Type == Operand::Kind::label or
+                    (branch and arg.Type == Operand::Kind::imm))
+                    work.push_back(arg.Value);
+            }
+
+            bool ends{(instr.Code == Op::jmp and instr.Argc == 1) or
+                      (instr.Code == Op::ret and instr.Argc == 0)};
+            if (not ends) work.push_back(addr + 1);
+        }
+
+        AnalyzeCalls();
+    }
+
+    // Инструкция по адресу addr, при ленивой загрузке декодируется при первом
+    // обращении. Интерпретатор получает const Program, поэтому кэш
+    // декодированных инструкций изменяется через const_cast: mutable члены
+    // GCC не позволяет читать при вычислении constexpr
+    [[nodiscard]] constexpr auto Fetch(size addr) const noexcept
+        -> const Instr & {
+        if (Lines.is_empty() or Decoded[addr]) return Code[addr];
+
+        auto &self{const_cast<Program &>(*this)};  // NOLINT const cast
+        self.Code[addr] = Decode(SplitLine(
+            Text + Lines[addr].Begin, Lines[addr].End - Lines[addr].Begin));
+        self.Decoded[addr] = true;
+
+        return Code[addr];
+    }
+
+    // Поиск ярлыков и строк инструкций по тем же правилам, что и ToWordArray
+    constexpr auto IndexLines(const char *txt, const size &len) noexcept
+        -> void {
+        size ind{};
+        while (ind < len) {
+            auto line_end{ind};
+            while (line_end < len and txt[line_end] != '\n') ++line_end;
+
+            while (ind < line_end) {
+                while (ind < line_end and txt[ind] == ' ') ++ind;
+                auto word_end{ind};
+                while (word_end < line_end and txt[word_end] != ' ')
+                    ++word_end;
+                if (word_end == ind) break;
+
+                if (txt[word_end - 1] != ':') {
+                    // Строка - комментарий
+                    if (txt[ind] != '#') Lines.push_back({ind, line_end});
+                    break;
+                }
+
+                // Слово - ярлык
+                String label;
+                for (auto chr{ind}; chr < word_end - 1; ++chr)
+                    label.push_back(txt[chr]);
+                if (label == "main")  // main: - начало программы
+                    Entry = static_cast<i64>(Lines.size());
+                Labels.push_back(vcai::move(label),
+                                 static_cast<i64>(Lines.size()));
+                ind = word_end;
+            }
+            ind = line_end + 1;
+        }
+    }
+
+    // Разбор строки инструкции на слова
+    [[nodiscard]] static constexpr auto SplitLine(const char *txt,
+                                                  const size &len) noexcept
+        -> DynamicArray<String> {
+        DynamicArray<String> words;
+        String word;
+        for (size ind{}; ind <= len; ++ind) {
+            if (ind < len and txt[ind] != ' ') {
+                word.push_back(txt[ind]);
+            } else if (not word.is_empty()) {
+                words.push_back(vcai::move(word));
+                word.clear();
+            }
+        }
+
+        return words;
+    }
+
+    // Поиск чистых функций и разметка их вызовов для мемоизации. Функция
+    // (цель call) чистая, если:
+    // - не использует sp, &r0-3/&a0-3 и векторные функции;
+    // - переходит только на ярлыки и вызывает только чистые функции;
+    // - не снимает со стека больше, чем положила, и выполняет ret с тем же
+    //   SP, с которым была вызвана.
+    // Выполнение такой функции зависит только от регистров, прочитанных до
+    // записи
+    constexpr auto AnalyzeCalls() noexcept -> void {  // NOLINT complexity
+        using Kind = Operand::Kind;
+        constexpr unsigned short ALL{(1 << MEMOREGS) - 1};
+        constexpr unsigned short ZFBIT{1 << 8}, SFBIT{1 << 9};
+
+        struct Node {
+            size Addr;
+            // Позиции следующих инструкций в Body, -1 - нет
+            StaticArray<i64, 2> Next;
+        };
+        struct Func {
+            i64 Addr{};
+            bool Pure{true};
+            // Функция содержит call или цикл - её выполнение дороже поиска
+            // в таблице мемоизации
+            bool Heavy{};
+            DynamicArray<Node> Body;
+            // Live - читаемые до записи, Must - записываемые на всех путях,
+            // May - записываемые хотя бы на одном пути
+            unsigned short Live{}, Must{ALL}, May{};
+        };
+
+        const auto prog_size{Code.size()};
+        auto target = [&](const Instr &instr) -> i64 {
+            const auto &arg{instr.Args[0]};
+            if (instr.Argc != 1) return -1;
+            if (arg.Type != Kind::label and arg.Type != Kind::imm) return -1;
+            if (arg.Value < 0 or arg.Value >= static_cast<i64>(prog_size))
+                return -1;
+            return arg.Value;
+        };
+
+        // Функции - цели call
+        DynamicArray<Func> funcs;
+        DynamicArray<i64> func_of, depth, pos;
+        for (size ind{}; ind < prog_size; ++ind) {
+            func_of.push_back(-1);
+            depth.push_back(-1);
+            pos.push_back(-1);
+        }
+        for (const auto &instr : Code) {
+            auto addr{target(instr)};
+            if (instr.Code != Op::call or addr == -1 or
+                func_of[static_cast<size>(addr)] != -1)
+                continue;
+            func_of[static_cast<size>(addr)] = static_cast<i64>(funcs.size());
+            funcs.push_back({});
+            funcs.back().Addr = addr;
+        }
+
+        auto reg_bit = [](const Operand &arg) -> unsigned short {
+            if (arg.Type == Kind::ir) return 1U << arg.Value;
+            if (arg.Type == Kind::ar) return 1U << (4 + arg.Value);
+            return 0;
+        };
+        // Читаемые, записываемые и записываемые всегда регистры инструкции
+        auto effects = [&](const Instr &instr, unsigned short &reads,
+                           unsigned short &writes, unsigned short &kills) {
+            reads = writes = kills = 0;
+            const auto func{instr.Code};
+            if (instr.Argc == 0 or instr.Argc > 3) return;
+
+            auto dst{reg_bit(instr.Args[0])};
+            if (instr.Argc == 3) {
+                reads = reg_bit(instr.Args[1]) | reg_bit(instr.Args[2]);
+                writes = kills = dst;
+            } else if (instr.Argc == 2) {
+                auto src{reg_bit(instr.Args[1])};
+                if (func == Op::cmp) {
+                    // При равенстве SF не меняется
+                    reads = dst | src;
+                    writes = ZFBIT | SFBIT;
+                    kills = ZFBIT;
+                } else {
+                    reads = func == Op::mov ? src : dst | src;
+                    writes = kills = dst;
+                }
+            } else if (func == Op::inc or func == Op::dec) {
+                reads = writes = kills = dst;
+            } else if (func >= Op::jl and func <= Op::jge) {
+                reads = ZFBIT | SFBIT;
+            } else if (func == Op::push) {
+                reads = dst;
+            } else if (func == Op::pop) {
+                writes = kills = dst;
+            }
+        };
+
+        // Обход тела каждой функции с проверкой SP
+        for (auto &func : funcs) {
+            DynamicArray<size> work;
+            auto visit = [&](size addr, i64 dep) -> i64 {
+                if (addr >= prog_size) return -2;
+                if (depth[addr] == -1) {
+                    depth[addr] = dep;
+                    pos[addr] = static_cast<i64>(func.Body.size());
+                    func.Body.push_back({addr, {-1, -1}});
+                    work.push_back(addr);
+                } else if (depth[addr] != dep) {
+                    return -2;
+                }
+                return pos[addr];
+            };
+            static_cast<void>(visit(static_cast<size>(func.Addr), 0));
+
+            while (func.Pure and not work.is_empty()) {
+                auto addr{work.back()};
+                work.pop_back();
+                const auto &instr{Code[addr]};
+                auto dep{depth[addr]};
+                auto fn{instr.Code};
+
+                bool valid{fn != Op::none and fn < Op::vadd};
+                if (instr.Argc >= 1 and instr.Argc <= 3) {
+                    valid = valid and valid_argc(fn, instr.Argc);
+                    for (size aind{}; aind < instr.Argc; ++aind) {
+                        auto type{instr.Args[aind].Type};
+                        valid = valid and type != Kind::none and
+                                type != Kind::vr and type != Kind::sp and
+                                type != Kind::stack_ir and
+                                type != Kind::stack_ar;
+                    }
+                }
+                if (fn == Op::push and instr.Argc == 1) ++dep;
+                if (fn == Op::pop and instr.Argc == 1 and dep-- == 0)
+                    valid = false;
+                if (not valid) {
+                    func.Pure = false;
+                    break;
+                }
+
+                StaticArray<i64, 2> next{-1, -1};
+                bool branch{fn >= Op::jmp and fn <= Op::call and
+                            instr.Argc == 1};
+                if (branch) {
+                    auto addr_to{target(instr)};
+                    if (addr_to == -1) {
+                        func.Pure = false;
+                        break;
+                    }
+                    if (fn == Op::call)
+                        func.Heavy = true;
+                    else
+                        next[0] = visit(static_cast<size>(addr_to), dep);
+                }
+                if (fn == Op::ret and instr.Argc == 0) {
+                    if (dep != 0) func.Pure = false;
+                } else if (fn != Op::jmp or not branch) {
+                    next[1] = visit(addr + 1, dep);
+                }
+
+                for (auto npos : next) {
+                    if (npos == -2) func.Pure = false;
+                    // Переход к уже найденной инструкции - возможно, цикл
+                    if (npos >= 0 and npos <= pos[addr]) func.Heavy = true;
+                }
+                func.Body[static_cast<size>(pos[addr])].Next = next;
+            }
+
+            for (const auto &node : func.Body) {
+                depth[node.Addr] = -1;
+                pos[node.Addr] = -1;
+            }
+        }
+
+        // Функция, вызывающая не чистую функцию, тоже не чистая
+        for (bool changed{true}; changed;) {
+            changed = false;
+            for (auto &func : funcs) {
+                if (not func.Pure) continue;
+                for (const auto &node : func.Body) {
+                    const auto &instr{Code[node.Addr]};
+                    if (instr.Code != Op::call) continue;
+                    auto callee{func_of[static_cast<size>(target(instr))]};
+                    if (not funcs[static_cast<size>(callee)].Pure) {
+                        func.Pure = false;
+                        changed = true;
+                        break;
+                    }
+                }
+            }
+        }
+
+        // Регистры функций зависят от регистров вызываемых функций, включая
+        // рекурсивные вызовы - вычисляются до неподвижной точки
+        DynamicArray<unsigned short> state;
+        for (bool changed{true}; changed;) {
+            changed = false;
+            for (auto &func : funcs) {
+                if (not func.Pure) continue;
+
+                auto node_effects = [&](const Node &node, unsigned short &reads,
+                                        unsigned short &writes,
+                                        unsigned short &kills) {
+                    const auto &instr{Code[node.Addr]};
+                    if (instr.Code == Op::call) {
+                        const auto &callee{funcs[static_cast<size>(
+                            func_of[static_cast<size>(target(instr))])]};
+                        reads = callee.Live;
+                        writes = callee.May;
+                        kills = callee.Must;
+                    } else {
+                        effects(instr, reads, writes, kills);
+                    }
+                };
+                unsigned short reads{}, writes{}, kills{};
+
+                // Записываемые на всех путях до ret
+                const auto body_size{func.Body.size()};
+                state.clear();
+                for (size npos{}; npos < body_size; ++npos)
+                    state.push_back(npos == 0 ? 0 : ALL);
+                unsigned short must{ALL}, may{};
+                for (bool again{true}; again;) {
+                    again = false;
+                    must = ALL;
+                    may = 0;
+                    for (size npos{}; npos < body_size; ++npos) {
+                        const auto &node{func.Body[npos]};
+                        node_effects(node, reads, writes, kills);
+                        may |= writes;
+                        auto out{
+                            static_cast<unsigned short>(state[npos] | kills)};
+                        if (Code[node.Addr].Code == Op::ret) must &= out;
+                        for (auto npos_to : node.Next) {
+                            if (npos_to < 0) continue;
+                            auto &in{state[static_cast<size>(npos_to)]};
+                            if ((in & out) != in) {
+                                in &= out;
+                                again = true;
+                            }
+                        }
+                    }
+                }
+
+                // Читаемые до записи
+                state.clear();
+                for (size npos{}; npos < body_size; ++npos) state.push_back(0);
+                for (bool again{true}; again;) {
+                    again = false;
+                    for (size npos{body_size}; npos-- > 0;) {
+                        const auto &node{func.Body[npos]};
+                        node_effects(node, reads, writes, kills);
+                        unsigned short out{};
+                        for (auto npos_to : node.Next)
+                            if (npos_to >= 0)
+                                out |= state[static_cast<size>(npos_to)];
+                        auto live{static_cast<unsigned short>(
+                            reads | (out & ~kills))};
+                        if (live != state[npos]) {
+                            state[npos] = live;
+                            again = true;
+                        }
+                    }
+                }
+
+                if (must != func.Must or may != func.May or
+                    state[0] != func.Live) {
+                    func.Must = must;
+                    func.May = may;
+                    func.Live = state[0];
+                    changed = true;
+                }
+            }
+        }
+
+        for (auto &instr : Code) {
+            if (instr.Code != Op::call or target(instr) == -1) continue;
+            const auto &func{
+                funcs[static_cast<size>(
+                    func_of[static_cast<size>(target(instr))])]};
+            if (not func.Pure or not func.Heavy) continue;
+
+            instr.MemoKey = func.Live;
+            instr.MemoOut = func.May;
+        }
+    }
+
+    // Разбор первых len символов txt на строки и слова, ярлыки добавляются
+    // в Labels с адресами относительно начала prog
+    constexpr auto ToWordArray(  // NOLINT complexity
+        const char *txt, const size &len,
+        DynamicArray<DynamicArray<String>> &prog) noexcept -> void {
+        DynamicArray<String> line;
+        String word;
+        // Проходимся по всем символам текста программы
+        for (size ind{}; ind <= len; ++ind) {
+            char chr{ind < len ? txt[ind] : '\0'};
+            if (chr != ' ' and chr != '\n' and chr != '\0') {
+                word.push_back(chr);
+            } else {
+                if (not word.is_empty()) {
+                    if (word.back() == ':' and line.is_empty()) {
+                        // Слово - ярлык
+                        if (word == "main:")  // main: - начало программы
+                            Entry = static_cast<i64>(prog.size());
+                        word.pop_back();  // Избавляемся от ':'
+                        Labels.push_back(vcai::move(word),
+                                         static_cast<i64>(prog.size()));
+                    } else
+                        line.push_back(vcai::move(word));
+                }
+                if (chr == '\n' or chr == 0) {
+                    if (not line.is_empty() and line[0].front() != '#')
+                        // Строка - комментарий
+                        prog.push_back(vcai::move(line));
+                    else
+                        line.clear();
+                }
+            }
+        }
+    }
+
+    // Номер регистра вида <prefix>0-3, -1 - слово не является таким регистром
+    [[nodiscard]] static constexpr auto RegIndex(const String &word,
+                                                 char prefix) noexcept
+        -> i64 {
+        if (word.size() != 2 or word[0] != prefix) return -1;
+        if (word[1] < '0' or word[1] > '3') return -1;
+
+        return word[1] - '0';
+    }
+
+    [[nodiscard]] constexpr auto DecodeWord(const String &word) const noexcept
+        -> Operand {
+        using Kind = Operand::Kind;
+
+        if (auto reg{RegIndex(word, 'r')}; reg != -1)
+            // Слово - регистр r0-3
+            return {Kind::ir, reg};
+        if (auto reg{RegIndex(word, 'a')}; reg != -1)
+            // Слово - регистр a0-3
+            return {Kind::ar, reg};
+        if (auto reg{RegIndex(word, 'v')}; reg != -1)
+            // Слово - векторный регистр v0-3
+            return {Kind::vr, reg};
+        if (word == "sp")
+            // Слово - регистр SP
+            return {Kind::sp, 0};
+        if (word.front() == '&') {
+            // Слово - указатель на адрес в стеке
+            String regname{&word[1]};
+            if (auto reg{RegIndex(regname, 'r')}; reg != -1)
+                return {Kind::stack_ir, reg};
+            if (auto reg{RegIndex(regname, 'a')}; reg != -1)
+                return {Kind::stack_ar, reg};
+            return {};
+        }
+        if (Labels.find(word) != -1)
+            // Слово - ярлык
+            return {Kind::label, Labels[word]};
+        if (word.is_i64())
+            // Слово - целочисленная константа
+            return {Kind::imm, word.to_i64()};
+
+        return {};
+    }
+
+    [[nodiscard]] constexpr auto Decode(
+        const DynamicArray<String> &line) const noexcept -> Instr {
+        Instr instr{};
+        auto func{line[0].func_id()};
+        if (func != -1) instr.Code = static_cast<Op>(func);
+
+        instr.Argc = line.size() - 1;
+        for (size aind{1}; aind < line.size() and aind <= 3; ++aind)
+            instr.Args[aind - 1] = DecodeWord(line[aind]);
+
+        return instr;
+    }
+
+    [[nodiscard]] constexpr Program() noexcept = default;
+
+    [[nodiscard]] constexpr explicit Program(const char *txt) noexcept {
+        Load(txt);
+    }
+};
+
+template <size N>
+[[nodiscard]] constexpr auto tabulate(const Program &prog, i64 first = 0,
+                                      const Input &input = {}) noexcept
+    -> StaticArray<i64, N>;
+
 class Interpreter {
     StaticArray<i64, 4> IntReg{};
     StaticArray<i64, 4> ArgReg{};
+    StaticArray<StaticArray<i64, VLANES>, 4> VecReg{};
     i64 SP{}, PC{};
     bool ZF{}, SF{};
+    size Steps{};
+#if defined(VCAI_TRACE)
+    Trace Tracer{};
+#endif
 
-    static constexpr size STACKSIZE{128};
     StaticArray<i64, STACKSIZE> Stack{};
     DynamicArray<i64> CallStack;
-    DynamicMap<String, i64> Labels;
-
-    StaticMap<String, i64 *, 4> StrToIR{
-        {String{"r0"}, String{"r1"}, String{"r2"}, String{"r3"}},
-        {&IntReg[0], &IntReg[1], &IntReg[2], &IntReg[3]}};
-
-    StaticMap<String, i64 *, 4> StrToAR{
-        {String{"a0"}, String{"a1"}, String{"a2"}, String{"a3"}},
-        {&ArgReg[0], &ArgReg[1], &ArgReg[2], &ArgReg[3]}};
+    const Program *Prog{};
+
+    // Результат вызова чистой функции
+    struct MemoEntry {
+        // Адрес функции, -1 - запись пуста
+        i64 Label{-1};
+        // Значения регистров Instr::MemoKey по порядку битов
+        StaticArray<i64, MEMOREGS> Key{};
+        // Записанные функцией регистры и их значения после ret
+        unsigned short Written{};
+        StaticArray<i64, MEMOREGS> Out{};
+        // Элементы стека от SP при вызове до наибольшего SP функции после
+        // ret: снятые значения остаются в стеке и видны через mov sp
+        DynamicArray<i64> Cells;
+    };
+    // Выполняемый вызов чистой функции, результат которого будет записан в
+    // таблицу при ret
+    struct MemoFrame {
+        size Slot{}, Depth{};
+        unsigned short Written{};
+        i64 Label{}, EntrySP{}, PeakSP{};
+        StaticArray<i64, MEMOREGS> Key{};
+    };
+    // Таблица прямого отображения, выделяется при первом вызове
+    DynamicArray<MemoEntry> Memo;
+    DynamicArray<MemoFrame> MemoFrames;
+    size MemoHits{}, MemoMisses{};
 
     // Операции с 3 аргументами
     static constexpr auto add(i64 &dst, i64 &src1, i64 &src2) noexcept -> void {
@@ -650,6 +1482,8 @@ class Interpreter {
     constexpr auto push(i64 &dst) noexcept -> void {
         Stack[static_cast<size>(SP)] = dst;
         ++SP;
+        if (not MemoFrames.is_empty() and SP > MemoFrames.back().PeakSP)
+            MemoFrames.back().PeakSP = SP;
     }
 
     constexpr auto pop(i64 &dst) noexcept -> void {
@@ -661,201 +1495,1960 @@ class Interpreter {
     constexpr auto ret() noexcept -> void {
         PC = CallStack.back();
         CallStack.pop_back();
+        if (not MemoFrames.is_empty() and
+            MemoFrames.back().Depth == CallStack.size())
+            MemoStore();
     }
 
-    DynamicArray<DynamicArray<String>> prog;
+    // Мемоизация вызовов чистых функций
+    [[nodiscard]] constexpr auto MemoReg(size bit) const noexcept -> i64 {
+        if (bit < 4) return IntReg[bit];
+        if (bit < 8) return ArgReg[bit - 4];  // NOLINT magic numbers
+        return bit == 8 ? ZF : SF;            // NOLINT magic numbers
+    }
 
-    constexpr auto ToWordArray(const char *txt) noexcept  // NOLINT complexity
-        -> void {
-        auto len{vcai::strlen(txt)};
+    constexpr auto SetMemoReg(size bit, i64 val) noexcept -> void {
+        if (bit < 4)
+            IntReg[bit] = val;
+        else if (bit < 8)  // NOLINT magic numbers
+            ArgReg[bit - 4] = val;
+        else if (bit == 8)  // NOLINT magic numbers
+            ZF = val != 0;
+        else
+            SF = val != 0;
+    }
 
-        DynamicArray<String> line;
-        String word;
-        // Проходимся по всем символам текста программы
-        for (size ind{}; ind <= len; ++ind) {
-            char chr{txt[ind]};
-            if (chr != ' ' and chr != '\n' and chr != '\0') {
-                word.push_back(chr);
-            } else {
-                if (not word.is_empty()) {
-                    if (word.back() == ':' and line.is_empty()) {
-                        // Слово - ярлык
-                        if (word == "main:") {  // main: - начало программы
-                            CallStack.push_back(0);
-                            PC = static_cast<int>(prog.size());
-                        }
-                        word.pop_back();  // Избавляемся от ':'
-                        Labels.push_back(vcai::move(word),
-                                         static_cast<i64>(prog.size()));
-                    } else
-                        line.push_back(vcai::move(word));
-                }
-                if (chr == '\n' or chr == 0) {
-                    if (not line.is_empty() and line[0].front() != '#')
-                        // Строка - комментарий
-                        prog.push_back(vcai::move(line));
-                    else
-                        line.clear();
-                }
-            }
+    // true - результат взят из таблицы, иначе вызов выполняется как обычно
+    [[nodiscard]] constexpr auto MemoCall(const Instr &instr) noexcept
+        -> bool {
+#if VCAI_MEMO_SIZE == 0
+        static_cast<void>(instr);
+        return false;
+#else
+        while (Memo.size() < MEMOSIZE) Memo.push_back({});
+
+        MemoFrame frame{};
+        frame.Label = instr.Args[0].Value;
+        frame.Depth = CallStack.size();
+        frame.EntrySP = frame.PeakSP = SP;
+
+        // FNV-1a по адресу функции и значениям ключа
+        size hash{14695981039346656037UL};  // NOLINT magic numbers
+        auto mix = [&hash](i64 val) {
+            hash ^= static_cast<size>(val);
+            hash *= 1099511628211UL;  // NOLINT magic numbers
+        };
+        mix(frame.Label);
+        size keys{};
+        for (size bit{}; bit < MEMOREGS; ++bit) {
+            if ((instr.MemoKey >> bit & 1U) == 0) continue;
+            frame.Key[keys] = MemoReg(bit);
+            mix(frame.Key[keys++]);
+        }
+        frame.Slot = (hash ^ hash >> 32U) % MEMOSIZE;  // NOLINT magic numbers
+
+        const auto &entry{Memo[frame.Slot]};
+        const auto depth{static_cast<i64>(entry.Cells.size())};
+        bool hit{entry.Label == frame.Label and
+                 SP + depth <= static_cast<i64>(STACKSIZE)};
+        for (size ind{}; hit and ind < keys; ++ind)
+            hit = entry.Key[ind] == frame.Key[ind];
+
+        if (not hit) {
+            ++MemoMisses;
+            MemoFrames.push_back(vcai::move(frame));
+            return false;
+        }
+
+        ++MemoHits;
+        for (size bit{}; bit < MEMOREGS; ++bit)
+            if ((entry.Written >> bit & 1U) != 0)
+                SetMemoReg(bit, entry.Out[bit]);
+        for (size ind{}; ind < entry.Cells.size(); ++ind)
+            Stack[static_cast<size>(SP) + ind] = entry.Cells[ind];
+        // Пропущенный вызов изменил бы регистры и стек объемлющего вызова
+        if (not MemoFrames.is_empty()) {
+            auto &outer{MemoFrames.back()};
+            outer.Written |= entry.Written;
+            if (SP + depth > outer.PeakSP) outer.PeakSP = SP + depth;
+        }
+
+        return true;
+#endif
+    }
+
+    constexpr auto MemoStore() noexcept -> void {
+        auto frame{MemoFrames.back()};
+        MemoFrames.pop_back();
+
+        auto &entry{Memo[frame.Slot]};
+        entry.Label = frame.Label;
+        entry.Key = frame.Key;
+        entry.Cells.clear();
+        for (auto ind{frame.EntrySP}; ind < frame.PeakSP; ++ind)
+            entry.Cells.push_back(Stack[static_cast<size>(ind)]);
+        entry.Written = frame.Written;
+        for (size bit{}; bit < MEMOREGS; ++bit)
+            if ((frame.Written >> bit & 1U) != 0) entry.Out[bit] = MemoReg(bit);
+
+        if (not MemoFrames.is_empty()) {
+            auto &outer{MemoFrames.back()};
+            outer.Written |= frame.Written;
+            if (frame.PeakSP > outer.PeakSP) outer.PeakSP = frame.PeakSP;
         }
     }
 
-    static constexpr auto call_fn3(const String &func, i64 *dst, i64 *src1,
-                                   i64 *src2) noexcept -> void {
-        if (func == "add")
-            add(*dst, *src1, *src2);
-        else if (func == "sub")
-            sub(*dst, *src1, *src2);
-        else if (func == "mul")
-            mul(*dst, *src1, *src2);
-        else if (func == "div")
-            div(*dst, *src1, *src2);
-        else if (func == "mod")
-            mod(*dst, *src1, *src2);
-        else                  // Синтаксическая ошибка
-            *(i64 *)0 = -12;  // NOLINT magic numbers
-    }
-
-    constexpr auto call_fn2(const String &func, i64 *dst, i64 *src) noexcept
+    // Регистры, записанные инструкцией чистой функции
+    [[nodiscard]] constexpr auto MemoWrites(const Instr &instr) const noexcept
+        -> unsigned short {
+        const auto &dst{instr.Args[0]};
+        switch (instr.Code) {
+            case Op::cmp:
+                // При равенстве SF не меняется
+                return ZF ? 1U << 8U : 3U << 8U;  // NOLINT magic numbers
+            case Op::jmp:
+            case Op::jl:
+            case Op::je:
+            case Op::jne:
+            case Op::jg:
+            case Op::jle:
+            case Op::jge:
+            case Op::call:
+            case Op::push:
+            case Op::ret:
+                return 0;
+            default:
+                if (instr.Argc == 0 or instr.Argc > 3) return 0;
+                if (dst.Type == Operand::Kind::ir) return 1U << dst.Value;
+                if (dst.Type == Operand::Kind::ar)
+                    return 1U << (4 + dst.Value);  // NOLINT magic numbers
+                return 0;
+        }
+    }
+
+    // Векторные операции (поэлементно над VLANES элементами)
+#if defined(__AVX2__)
+    static auto vload(const i64 *src) noexcept -> __m256i {
+        return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src));
+    }
+
+    static auto vstore(i64 *dst, __m256i val) noexcept -> void {
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst), val);
+    }
+#endif
+
+    static constexpr auto vadd(i64 *dst, i64 *src1, i64 *src2) noexcept
         -> void {
-        if (func == "add")
-            add(*dst, *src);
-        else if (func == "sub")
-            sub(*dst, *src);
-        else if (func == "mul")
-            mul(*dst, *src);
-        else if (func == "div")
-            div(*dst, *src);
-        else if (func == "mod")
-            mod(*dst, *src);
-        else if (func == "cmp")
-            cmp(*dst, *src);
-        else if (func == "mov")
-            mov(*dst, *src);
-        else if (func == "shl")
-            shl(*dst, *src);
-        else if (func == "shr")
-            shr(*dst, *src);
-        else if (func == "xor")
-            v_xor(*dst, *src);
-        else if (func == "and")
-            v_and(*dst, *src);
-        else if (func == "or")
-            v_or(*dst, *src);
-        else                  // Синтаксическая ошибка
-            *(i64 *)0 = -12;  // NOLINT magic numbers
-    }
-
-    constexpr auto call_fn1(const String &func, i64 *dst) noexcept -> void {
-        if (func == "inc")
-            inc(*dst);
-        else if (func == "dec")
-            dec(*dst);
-        else if (func == "jmp")
-            jmp(*dst);
-        else if (func == "jl")
-            jl(*dst);
-        else if (func == "je")
-            je(*dst);
-        else if (func == "jne")
-            jne(*dst);
-        else if (func == "jg")
-            jg(*dst);
-        else if (func == "jle")
-            jle(*dst);
-        else if (func == "jge")
-            jge(*dst);
-        else if (func == "call")
-            call(*dst);
-        else if (func == "push")
-            push(*dst);
-        else if (func == "pop")
-            pop(*dst);
-        else                  // Синтаксическая ошибка
-            *(i64 *)0 = -12;  // NOLINT magic numbers
-    }
-
-    [[nodiscard]] constexpr auto deref(const String &str) const noexcept
-        -> i64 {
-        // Первый символ = '&'
-        String regname{&str[1]};
-        i64 reg{StrToIR.find(regname)};
-        if (reg != -1) return *StrToIR[regname];
+#if defined(__AVX2__)
+        if (not __builtin_is_constant_evaluated())
+            return vstore(dst, _mm256_add_epi64(vload(src1), vload(src2)));
+#endif
+        for (size lane{}; lane < VLANES; ++lane)
+            dst[lane] = src1[lane] + src2[lane];
+    }
 
-        reg = StrToAR.find(regname);
-        if (reg != -1) return *StrToAR[regname];
+    static constexpr auto vsub(i64 *dst, i64 *src1, i64 *src2) noexcept
+        -> void {
+#if defined(__AVX2__)
+        if (not __builtin_is_constant_evaluated())
+            return vstore(dst, _mm256_sub_epi64(vload(src1), vload(src2)));
+#endif
+        for (size lane{}; lane < VLANES; ++lane)
+            dst[lane] = src1[lane] - src2[lane];
+    }
 
-        return -1;
+    // В AVX2 нет умножения 64-битных элементов - только переносимый вариант
+    static constexpr auto vmul(i64 *dst, i64 *src1, i64 *src2) noexcept
+        -> void {
+        for (size lane{}; lane < VLANES; ++lane)
+            dst[lane] = src1[lane] * src2[lane];
     }
 
-    [[nodiscard]] constexpr auto Exec() noexcept -> i64 {  // NOLINT complexity
-        const auto prog_size{prog.size()};
-        // Для завершения работы интерпретатор должен дойти до конца файла либо
-        // опустошить CallStack
-        while (PC < static_cast<i64>(prog_size) and !CallStack.is_empty()) {
-            auto &line = prog[static_cast<size>(PC)];
-
-            StaticArray<i64 *, 3> lvalues{0, 0, 0};
-            StaticArray<i64, 3> rvalues{0, 0, 0};
-
-            const auto line_size{line.size()};
-            for (size aind{1}; aind < line_size; ++aind) {
-                if (StrToIR.find(line[aind]) != -1)
-                    // Слово - регистр r0-3
-                    lvalues[aind - 1] = StrToIR[line[aind]];
-                else if (StrToAR.find(line[aind]) != -1)
-                    // Слово - регистр a0-3
-                    lvalues[aind - 1] = StrToAR[line[aind]];
-                else if (line[aind] == "sp")
-                    // Слово - регистр SP
-                    lvalues[aind - 1] = &SP;
-                else if (line[aind].front() == '&') {
-                    // Слово - указатель на адрес в стеке
-                    auto ind{deref(line[aind])};
-                    if (ind != -1 && ind < SP)
-                        lvalues[aind - 1] = &Stack[static_cast<size>(ind)];
-                } else if (Labels.find(line[aind]) != -1)
-                    // Слово - ярлык
-                    lvalues[aind - 1] = &Labels[line[aind]];
-                else if (line[aind].is_i64()) {
-                    // Слово - целочисленная константа
-                    rvalues[aind - 1] = line[aind].to_i64();
-                    lvalues[aind - 1] = &rvalues[aind - 1];
-                }
-            }
+    static constexpr auto vxor(i64 *dst, i64 *src) noexcept -> void {
+#if defined(__AVX2__)
+        if (not __builtin_is_constant_evaluated())
+            return vstore(dst, _mm256_xor_si256(vload(dst), vload(src)));
+#endif
+        for (size lane{}; lane < VLANES; ++lane)
+            dst[lane] ^= src[lane];  // NOLINT binary op on int
+    }
 
-            // В отличие от регистров, с функциями трюк со StaticMap не работает
-            // (по крайнем мере, у меня не вышло)
-            String *func{};
-            if (line[0].is_func()) func = &line[0];
-            if (line_size == 4)
-                call_fn3(*func, lvalues[0], lvalues[1], lvalues[2]);
-            else if (line_size == 3)
-                call_fn2(*func, lvalues[0], lvalues[1]);
-            else if (line_size == 2)
-                call_fn1(*func, lvalues[0]);
-            else if (line_size == 1)
-                if (*func == "ret") ret();
+    static constexpr auto vand(i64 *dst, i64 *src) noexcept -> void {
+#if defined(__AVX2__)
+        if (not __builtin_is_constant_evaluated())
+            return vstore(dst, _mm256_and_si256(vload(dst), vload(src)));
+#endif
+        for (size lane{}; lane < VLANES; ++lane)
+            dst[lane] &= src[lane];  // NOLINT binary op on int
+    }
 
-            ++PC;
-        }  // while
+    static constexpr auto vor(i64 *dst, i64 *src) noexcept -> void {
+#if defined(__AVX2__)
+        if (not __builtin_is_constant_evaluated())
+            return vstore(dst, _mm256_or_si256(vload(dst), vload(src)));
+#endif
+        for (size lane{}; lane < VLANES; ++lane)
+            dst[lane] |= src[lane];  // NOLINT binary op on int
+    }
 
-        return IntReg[0];
+    static constexpr auto vshl(i64 *dst, i64 *src) noexcept -> void {
+#if defined(__AVX2__)
+        if (not __builtin_is_constant_evaluated())
+            return vstore(dst, _mm256_sllv_epi64(vload(dst), vload(src)));
+#endif
+        for (size lane{}; lane < VLANES; ++lane)
+            dst[lane] <<= src[lane];  // NOLINT binary op on int
     }
 
-    // Нельзя создавать вне exec_fn()
-    Interpreter() = default;
+    // Арифметический сдвиг 64-битных элементов появился только в AVX-512
+    static constexpr auto vshr(i64 *dst, i64 *src) noexcept -> void {
+        for (size lane{}; lane < VLANES; ++lane)
+            dst[lane] >>= src[lane];  // NOLINT binary op on int
+    }
 
-    friend constexpr auto exec_fn(const char *txt) noexcept -> i64;
-};
+    static constexpr auto vbrd(i64 *dst, i64 *src) noexcept -> void {
+        for (size lane{}; lane < VLANES; ++lane) dst[lane] = *src;
+    }
 
-[[nodiscard]] constexpr auto exec_fn(const char *txt) noexcept -> i64 {
-    Interpreter interp{};
-    interp.ToWordArray(txt);
-    i64 ret{interp.Exec()};
+    static constexpr auto vsum(i64 *dst, i64 *src) noexcept -> void {
+        i64 sum{};
+        for (size lane{}; lane < VLANES; ++lane) sum += src[lane];
+        *dst = sum;
+    }
 
-    return ret;
+    // Stack[src]...Stack[src + VLANES - 1] -> dst
+    constexpr auto vld(i64 *dst, i64 *src) noexcept -> void {
+        if (*src < 0 or *src + static_cast<i64>(VLANES) > SP)
+            *(i64 *)0 = -13;  // NOLINT выход за пределы стека
+        for (size lane{}; lane < VLANES; ++lane)
+            dst[lane] = Stack[static_cast<size>(*src) + lane];
+    }
+
+    // src -> Stack[dst]...Stack[dst + VLANES - 1]
+    constexpr auto vst(i64 *src, i64 *dst) noexcept -> void {
+        if (*dst < 0 or *dst + static_cast<i64>(VLANES) > SP)
+            *(i64 *)0 = -13;  // NOLINT выход за пределы стека
+        for (size lane{}; lane < VLANES; ++lane)
+            Stack[static_cast<size>(*dst) + lane] = src[lane];
+    }
+
+    constexpr auto vpush(i64 *src) noexcept -> void {
+        for (size lane{}; lane < VLANES; ++lane) push(src[lane]);
+    }
+
+    constexpr auto vpop(i64 *dst) noexcept -> void {
+        for (size lane{VLANES}; lane > 0; --lane) pop(dst[lane - 1]);
+    }
+
+    // Векторные функции работают с VLANES элементами аргумента, поэтому
+    // векторными должны быть ровно те аргументы, что описаны в README
+    [[nodiscard]] static constexpr auto VectorArgs(const Instr &instr) noexcept
+        -> bool {
+        auto is_vr = [&instr](size aind) {
+            return instr.Args[aind].Type == Operand::Kind::vr;
+        };
+
+        switch (instr.Code) {
+            case Op::vbrd:
+            case Op::vld:
+            case Op::vst:
+                return is_vr(0) and not is_vr(1);
+            case Op::vsum:
+                return not is_vr(0) and is_vr(1);
+            default:
+                for (size aind{}; aind < instr.Argc and aind < 3; ++aind)
+                    if (not is_vr(aind)) return false;
+                return true;
+        }
+    }
+
+    static constexpr auto call_fn3(Op func, i64 *dst, i64 *src1,
+                                   i64 *src2) noexcept -> void {
+        switch (func) {
+            case Op::add:
+                add(*dst, *src1, *src2);
+                break;
+            case Op::sub:
+                sub(*dst, *src1, *src2);
+                break;
+            case Op::mul:
+                mul(*dst, *src1, *src2);
+                break;
+            case Op::div:
+                div(*dst, *src1, *src2);
+                break;
+            case Op::mod:
+                mod(*dst, *src1, *src2);
+                break;
+            case Op::vadd:
+                vadd(dst, src1, src2);
+                break;
+            case Op::vsub:
+                vsub(dst, src1, src2);
+                break;
+            case Op::vmul:
+                vmul(dst, src1, src2);
+                break;
+            default:              // Синтаксическая ошибка
+                *(i64 *)0 = -12;  // NOLINT magic numbers
+        }
+    }
+
+    constexpr auto call_fn2(Op func, i64 *dst,  // NOLINT complexity
+                            i64 *src) noexcept -> void {
+        switch (func) {
+            case Op::add:
+                add(*dst, *src);
+                break;
+            case Op::sub:
+                sub(*dst, *src);
+                break;
+            case Op::mul:
+                mul(*dst, *src);
+                break;
+            case Op::div:
+                div(*dst, *src);
+                break;
+            case Op::mod:
+                mod(*dst, *src);
+                break;
+            case Op::cmp:
+                cmp(*dst, *src);
+                break;
+            case Op::mov:
+                mov(*dst, *src);
+                break;
+            case Op::shl:
+                shl(*dst, *src);
+                break;
+            case Op::shr:
+                shr(*dst, *src);
+                break;
+            case Op::v_xor:
+                v_xor(*dst, *src);
+                break;
+            case Op::v_and:
+                v_and(*dst, *src);
+                break;
+            case Op::v_or:
+                v_or(*dst, *src);
+                break;
+            case Op::vadd:
+                vadd(dst, dst, src);
+                break;
+            case Op::vsub:
+                vsub(dst, dst, src);
+                break;
+            case Op::vmul:
+                vmul(dst, dst, src);
+                break;
+            case Op::vxor:
+                vxor(dst, src);
+                break;
+            case Op::vand:
+                vand(dst, src);
+                break;
+            case Op::vor:
+                vor(dst, src);
+                break;
+            case Op::vshl:
+                vshl(dst, src);
+                break;
+            case Op::vshr:
+                vshr(dst, src);
+                break;
+            case Op::vbrd:
+                vbrd(dst, src);
+                break;
+            case Op::vsum:
+                vsum(dst, src);
+                break;
+            case Op::vld:
+                vld(dst, src);
+                break;
+            case Op::vst:
+                vst(dst, src);
+                break;
+            default:              // Синтаксическая ошибка
+                *(i64 *)0 = -12;  // NOLINT magic numbers
+        }
+    }
+
+    constexpr auto call_fn1(Op func, i64 *dst) noexcept -> void {
+        switch (func) {
+            case Op::inc:
+                inc(*dst);
+                break;
+            case Op::dec:
+                dec(*dst);
+                break;
+            case Op::jmp:
+                jmp(*dst);
+                break;
+            case Op::jl:
+                jl(*dst);
+                break;
+            case Op::je:
+                je(*dst);
+                break;
+            case Op::jne:
+                jne(*dst);
+                break;
+            case Op::jg:
+                jg(*dst);
+                break;
+            case Op::jle:
+                jle(*dst);
+                break;
+            case Op::jge:
+                jge(*dst);
+                break;
+            case Op::call:
+                call(*dst);
+                break;
+            case Op::push:
+                push(*dst);
+                break;
+            case Op::pop:
+                pop(*dst);
+                break;
+            case Op::vpush:
+                vpush(dst);
+                break;
+            case Op::vpop:
+                vpop(dst);
+                break;
+            default:              // Синтаксическая ошибка
+                *(i64 *)0 = -12;  // NOLINT magic numbers
+        }
+    }
+
+    // Указатель на значение аргумента, константы кладутся в tmp
+    [[nodiscard]] constexpr auto Resolve(const Operand &arg, i64 &tmp) noexcept
+        -> i64 * {
+        const auto reg{static_cast<size>(arg.Value)};
+        i64 ind{-1};
+        switch (arg.Type) {
+            case Operand::Kind::ir:
+                return &IntReg[reg];
+            case Operand::Kind::ar:
+                return &ArgReg[reg];
+            case Operand::Kind::vr:
+                // Векторный регистр передаётся как указатель на первый элемент
+                return &VecReg[reg][0];
+            case Operand::Kind::sp:
+                return &SP;
+            case Operand::Kind::stack_ir:
+                ind = IntReg[reg];
+                break;
+            case Operand::Kind::stack_ar:
+                ind = ArgReg[reg];
+                break;
+            case Operand::Kind::label:
+            case Operand::Kind::imm:
+                tmp = arg.Value;
+                return &tmp;
+            default:
+                return nullptr;
+        }
+
+        if (ind != -1 && ind < SP) return &Stack[static_cast<size>(ind)];
+        return nullptr;
+    }
+
+    [[nodiscard]] constexpr auto IsRunning() const noexcept -> bool {
+        // Для завершения работы интерпретатор должен дойти до конца файла либо
+        // опустошить CallStack
+        return PC < static_cast<i64>(Prog->Code.size()) and
+               !CallStack.is_empty();
+    }
+
+    // Выполнение одной инструкции
+    constexpr auto Step() noexcept -> void {
+        const auto &instr{Prog->Fetch(static_cast<size>(PC))};
+#if defined(VCAI_TRACE)
+        TraceEvent event{};
+        event.PC = static_cast<u32>(PC);
+        event.Depth = static_cast<unsigned short>(CallStack.size());
+        event.Opcode = static_cast<unsigned char>(instr.Code);
+#endif
+
+        if (instr.Code >= Op::vadd and instr.Code <= Op::vpop and
+            not VectorArgs(instr))  // Синтаксическая ошибка
+            *(i64 *)0 = -12;        // NOLINT magic numbers
+
+        StaticArray<i64 *, 3> lvalues{0, 0, 0};
+        StaticArray<i64, 3> rvalues{0, 0, 0};
+        for (size aind{}; aind < instr.Argc and aind < 3; ++aind)
+            lvalues[aind] = Resolve(instr.Args[aind], rvalues[aind]);
+
+        if (instr.MemoOut != 0 and MemoCall(instr)) {
+            // Вызов чистой функции заменён результатом из таблицы
+        } else if (instr.Argc == 3)
+            call_fn3(instr.Code, lvalues[0], lvalues[1], lvalues[2]);
+        else if (instr.Argc == 2)
+            call_fn2(instr.Code, lvalues[0], lvalues[1]);
+        else if (instr.Argc == 1)
+            call_fn1(instr.Code, lvalues[0]);
+        else if (instr.Argc == 0) {
+            if (instr.Code == Op::ret)
+                ret();
+            else if (instr.Code == Op::none)  // Синтаксическая ошибка
+                *(i64 *)0 = -12;              // NOLINT magic numbers
+        }
+
+        if (not MemoFrames.is_empty())
+            MemoFrames.back().Written |= MemoWrites(instr);
+
+#if defined(VCAI_TRACE)
+        if (lvalues[0] != nullptr) event.Dst = *lvalues[0];
+        if (ZF) event.Flags |= TraceEvent::ZFBIT;
+        if (SF) event.Flags |= TraceEvent::SFBIT;
+        Tracer.push_back(event);
+#endif
+        ++PC;
+        ++Steps;
+    }
+
+    [[nodiscard]] constexpr auto Exec() noexcept -> i64 {
+        while (IsRunning()) Step();
+
+        return IntReg[0];
+    }
+
+    // Выполнение не более max_steps инструкций, true - программа завершена
+    constexpr auto Run(const size &max_steps) noexcept -> bool {
+        for (size step{}; step < max_steps and IsRunning(); ++step) Step();
+
+        return not IsRunning();
+    }
+
+    [[nodiscard]] constexpr auto Result() const noexcept -> ExecResult {
+        ExecResult res{};
+        res.IntReg = IntReg;
+        res.ArgReg = ArgReg;
+        res.VecReg = VecReg;
+        res.SP = SP;
+        // SP может быть любым после mov sp
+        for (i64 ind{}; ind < SP and ind < static_cast<i64>(STACKSIZE); ++ind)
+            res.Stack[static_cast<size>(ind)] = Stack[static_cast<size>(ind)];
+        res.Steps = Steps;
+        res.MemoHits = MemoHits;
+        res.MemoMisses = MemoMisses;
+#if defined(VCAI_TRACE)
+        res.Tracer = Tracer;
+#endif
+
+        return res;
+    }
+
+    // Начальное состояние для выполнения программы с input. Таблица
+    // мемоизации сохраняется: её записи зависят только от программы
+    constexpr auto Reset(const Input &input) noexcept -> void {
+        IntReg = {};
+        ArgReg = input.ArgReg;
+        VecReg = {};
+        SP = input.SP;
+        PC = 0;
+        ZF = SF = false;
+        Steps = MemoHits = MemoMisses = 0;
+#if defined(VCAI_TRACE)
+        Tracer = {};
+#endif
+        // Весь стек: элементы выше SP видны через mov sp и после прошлого
+        // выполнения должны снова стать нулями
+        for (size ind{}; ind < STACKSIZE; ++ind)
+            Stack[ind] = static_cast<i64>(ind) < SP ? input.Stack[ind] : 0;
+
+        CallStack.clear();
+        MemoFrames.clear();
+        if (Prog->Entry != -1) {
+            CallStack.push_back(0);
+            PC = Prog->Entry;
+        }
+    }
+
+    // Нельзя создавать вне exec_fn()
+    constexpr explicit Interpreter(const Program &prog,
+                                   const Input &input = {}) noexcept
+        : Prog(&prog) {
+        Reset(input);
+    }
+
+    friend constexpr auto exec_fn(const Program &prog,
+                                  const Input &input) noexcept -> i64;
+    friend constexpr auto exec_full(const Program &prog,
+                                    const Input &input) noexcept
+        -> ExecResult;
+    template <size N>
+    friend constexpr auto tabulate(const Program &prog, i64 first,
+                                   const Input &input) noexcept
+        -> StaticArray<i64, N>;
+    friend class Task;
+};
+
+[[nodiscard]] constexpr auto exec_fn(const Program &prog,
+                                     const Input &input = {}) noexcept -> i64 {
+    Interpreter interp{prog, input};
+    i64 ret{interp.Exec()};
+
+    return ret;
+}
+
+[[nodiscard]] constexpr auto exec_fn(const char *txt) noexcept -> i64 {
+    Program prog{txt};
+
+    return exec_fn(prog);
+}
+
+[[nodiscard]] constexpr auto exec_full(const Program &prog,
+                                       const Input &input = {}) noexcept
+    -> ExecResult {
+    Interpreter interp{prog, input};
+    static_cast<void>(interp.Exec());
+
+    return interp.Result();
+}
+
+[[nodiscard]] constexpr auto exec_full(const char *txt) noexcept
+    -> ExecResult {
+    Program prog{txt};
+
+    return exec_full(prog);
+}
+
+// Таблица результатов (r0) программы для a0 = first, first + 1, ...,
+// first + N - 1, остальные входные данные берутся из input. Программа
+// загружается один раз, интерпретатор и таблица мемоизации используются для
+// всех значений. В constexpr-контексте таблица вычисляется при компиляции
+template <size N>
+[[nodiscard]] constexpr auto tabulate(const Program &prog, i64 first,
+                                      const Input &input) noexcept
+    -> StaticArray<i64, N> {
+    StaticArray<i64, N> table{};
+    auto args{input};
+    Interpreter interp{prog, args};
+    for (size ind{}; ind < N; ++ind) {
+        args.ArgReg[0] = first + static_cast<i64>(ind);
+        interp.Reset(args);
+        table[ind] = interp.Exec();
+    }
+
+    return table;
+}
+
+template <size N>
+[[nodiscard]] constexpr auto tabulate(const char *txt, i64 first = 0) noexcept
+    -> StaticArray<i64, N> {
+    Program prog{txt};
+
+    return tabulate<N>(prog, first, {});
+}
+
+// Программа, выполняемая по частям
+class Task {
+   public:
+    [[nodiscard]] constexpr explicit Task(const char *txt,
+                                          const Input &input = {}) noexcept
+        : m_prog(txt), m_interp(m_prog, input) {}
+
+    // prog должна существовать до завершения работы с Task
+    [[nodiscard]] constexpr explicit Task(const Program &prog,
+                                          const Input &input = {}) noexcept
+        : m_interp(prog, input) {}
+
+    // Выполняет не более max_steps инструкций, true - программа завершена
+    constexpr auto run(const vcai::size &max_steps) noexcept -> bool {
+        return m_interp.Run(max_steps);
+    }
+
+    [[nodiscard]] constexpr auto is_done() const noexcept -> bool {
+        return not m_interp.IsRunning();
+    }
+
+    [[nodiscard]] constexpr auto steps() const noexcept -> vcai::size {
+        return m_interp.Steps;
+    }
+
+    [[nodiscard]] constexpr auto result() const noexcept -> ExecResult {
+        return m_interp.Result();
+    }
+
+   private:
+    Program m_prog;
+    Interpreter m_interp;
+};
+
+// Кооперативный планировщик: задачи выполняются по очереди, каждой за круг
+// выделяется не более quantum инструкций. Время измеряется в инструкциях,
+// выполненных всеми задачами планировщика
+class Scheduler {
+   public:
+    [[nodiscard]] constexpr explicit Scheduler(
+        const vcai::size &quantum) noexcept
+        : m_quantum(quantum) {}
+
+    // Возвращает идентификатор задачи
+    constexpr auto submit(const char *txt, const Input &input = {}) noexcept
+        -> vcai::size {
+        return Add(new Task{txt, input});  // NOLINT owning memory
+    }
+
+    // prog должна существовать до уничтожения планировщика
+    constexpr auto submit(const Program &prog,
+                          const Input &input = {}) noexcept -> vcai::size {
+        return Add(new Task{prog, input});  // NOLINT owning memory
+    }
+
+    // Один круг по всем незавершённым задачам, true - остались незавершённые
+    constexpr auto run_round() noexcept -> bool {
+        DynamicArray<vcai::size> active;
+        for (const auto &slot : m_active) {
+            auto &task{*m_tasks[slot]};
+            auto before{task.steps()};
+            bool done{task.run(m_quantum)};
+            m_clock += task.steps() - before;
+
+            if (done)
+                m_finished[slot] = m_clock;
+            else
+                active.push_back(slot);
+        }
+        m_active = vcai::move(active);
+
+        return not m_active.is_empty();
+    }
+
+    constexpr auto run() noexcept -> void {
+        while (run_round()) {
+        }
+    }
+
+    // Задачи, добавленные и ещё не забранные через take()
+    [[nodiscard]] constexpr auto size() const noexcept {
+        return m_tasks.size() - m_free.size();
+    }
+    [[nodiscard]] constexpr auto pending() const noexcept {
+        return m_active.size();
+    }
+    [[nodiscard]] constexpr auto clock() const noexcept { return m_clock; }
+
+    // Для id забранной через take() задачи - false
+    [[nodiscard]] constexpr auto is_done(const vcai::size &id) const noexcept
+        -> bool {
+        auto slot{Slot(id)};
+        return slot != NOSLOT and m_tasks[slot]->is_done();
+    }
+
+    // Для id забранной через take() задачи - ExecResult{}
+    [[nodiscard]] constexpr auto result(const vcai::size &id) const noexcept
+        -> ExecResult {
+        auto slot{Slot(id)};
+        if (slot == NOSLOT) return {};
+        return m_tasks[slot]->result();
+    }
+
+    // Результат задачи (незавершённая снимается с выполнения). Задача
+    // удаляется, её место занимает следующая добавленная задача с другим id.
+    // Повторный take() возвращает ExecResult{}
+    [[nodiscard]] constexpr auto take(const vcai::size &id) noexcept
+        -> ExecResult {
+        auto slot{Slot(id)};
+        if (slot == NOSLOT) return {};
+
+        DynamicArray<vcai::size> active;
+        for (const auto &aslot : m_active)
+            if (aslot != slot) active.push_back(aslot);
+        m_active = vcai::move(active);
+
+        auto res{m_tasks[slot]->result()};
+        delete m_tasks[slot];  // NOLINT owning memory
+        m_tasks[slot] = nullptr;
+        ++m_generations[slot];
+        m_free.push_back(slot);
+
+        return res;
+    }
+
+    // Время от добавления задачи до её завершения, NOTDONE - задача не
+    // завершена или забрана через take()
+    static constexpr vcai::size NOTDONE{~vcai::size{}};
+    [[nodiscard]] constexpr auto latency(const vcai::size &id) const noexcept
+        -> vcai::size {
+        auto slot{Slot(id)};
+        if (slot == NOSLOT or not m_tasks[slot]->is_done()) return NOTDONE;
+        return m_finished[slot] - m_submitted[slot];
+    }
+
+    // Правило 5
+    constexpr Scheduler(const Scheduler &other) noexcept = delete;
+    constexpr Scheduler(Scheduler &&other) noexcept = delete;
+    constexpr auto operator=(const Scheduler &other) noexcept = delete;
+    constexpr auto operator=(Scheduler &&other) noexcept = delete;
+
+    constexpr ~Scheduler() noexcept {
+        for (auto *task : m_tasks) delete task;  // NOLINT owning memory
+    }
+
+   private:
+    // id задачи - номер места в m_tasks в младших SLOTBITS битах и номер
+    // использования этого места в старших
+    static constexpr vcai::size SLOTBITS{32};  // NOLINT magic numbers
+    static constexpr vcai::size NOSLOT{~vcai::size{}};
+
+    // Место задачи id, NOSLOT - задача забрана или id не выдавался
+    [[nodiscard]] constexpr auto Slot(const vcai::size &id) const noexcept
+        -> vcai::size {
+        const auto slot{id & ((vcai::size{1} << SLOTBITS) - 1)};
+        if (slot >= m_tasks.size() or m_tasks[slot] == nullptr or
+            m_generations[slot] != id >> SLOTBITS)
+            return NOSLOT;
+        return slot;
+    }
+
+    constexpr auto Add(Task *task) noexcept -> vcai::size {
+        vcai::size slot{};
+        if (m_free.is_empty()) {
+            slot = m_tasks.size();
+            m_tasks.push_back(task);
+            m_generations.push_back(0);
+            m_submitted.push_back(m_clock);
+            m_finished.push_back(m_clock);
+        } else {
+            // Место задачи, забранной через take()
+            slot = m_free.back();
+            m_free.pop_back();
+            m_tasks[slot] = task;
+            m_submitted[slot] = m_finished[slot] = m_clock;
+        }
+        if (not task->is_done()) m_active.push_back(slot);
+
+        return slot | m_generations[slot] << SLOTBITS;
+    }
+
+    DynamicArray<Task *> m_tasks;
+    DynamicArray<vcai::size> m_generations;
+    DynamicArray<vcai::size> m_submitted;
+    DynamicArray<vcai::size> m_finished;
+    // Места незавершённых задач и места, освобождённые take()
+    DynamicArray<vcai::size> m_active;
+    DynamicArray<vcai::size> m_free;
+    vcai::size m_quantum{};
+    vcai::size m_clock{};
+};
+
+// Входные данные, известные при специализации программы
+struct KnownInput {
+    // Значения известных a0-a3 и элементов стека. Размер начального стека
+    // Values.SP известен всегда
+    Input Values{};
+    // ArgKnown[i] - известно значение a<i>
+    StaticArray<bool, 4> ArgKnown{};
+    // Известны первые StackKnown элементов стека
+    i64 StackKnown{};
+};
+
+// Частичный вычислитель: выполняет программу над известными входными данными
+// и строит текст остаточной программы из инструкций, зависящих от неизвестных.
+// Известные значения подставляются как константы, переходы по известным флагам
+// разрешаются, циклы с известными границами разворачиваются, вызовы
+// встраиваются. Если адрес получил больше MAXVARIANTS вариантов известных
+// значений, различающиеся значения становятся неизвестными, и код адреса
+// используется повторно. Если специализировать дальше нельзя (переход по
+// вычисленному адресу, неизвестный индекс, превышены ограничения),
+// известное состояние записывается в регистры и стек, и выполнение
+// продолжается в копии исходной программы. Рекурсивные вызовы чистых функций
+// с неизвестными аргументами выполняются копией. Остаточная программа
+// выполняется с теми же Input
+class Specializer {
+   public:
+    // Ограничения: количество абстрактно выполненных инструкций и количество
+    // вариантов одной инструкции с разными SP и call-стеком, а также с
+    // разными известными значениями при тех же SP и call-стеке
+    static constexpr size MAXSTEPS{1 << 20};  // NOLINT magic numbers
+    static constexpr size MAXVARIANTS{8};     // NOLINT magic numbers
+
+    [[nodiscard]] constexpr Specializer(const Program &prog,
+                                        const KnownInput &known) noexcept
+        : Prog(&prog) {
+        for (size reg{}; reg < 4; ++reg) {
+            // Регистры остаточной программы тоже начинаются с нуля
+            Init.IntReg[reg] = {true, 0, true};
+            if (known.ArgKnown[reg]) Init.ArgReg[reg] = Known(known, reg);
+        }
+
+        Init.SP = Init.PhysSP = known.Values.SP;
+        for (size ind{}; ind < STACKSIZE; ++ind) {
+            if (static_cast<i64>(ind) >= known.Values.SP)
+                Init.Stack[ind] = {true, 0, true};
+            else if (static_cast<i64>(ind) < known.StackKnown)
+                Init.Stack[ind] = {true, known.Values.Stack[ind], true};
+        }
+        Init.ZF = Init.SF = {true, 0, true};
+
+        Init.PC = prog.Entry;
+        Init.CallStack.push_back(0);
+    }
+
+    [[nodiscard]] constexpr auto Run() noexcept -> String {
+        if (Prog->Entry == -1) return {};
+
+        Blocks.push_back({Init, Block::Kind::walk, 0, true});
+        Out.append("main:\n");
+        Walk(Init);
+
+        while (not Pending.is_empty()) {
+            auto id{Pending.back()};
+            Pending.pop_back();
+
+            auto state{Blocks[id].St};
+            Label(BlockLabel(id));
+            if (Blocks[id].Type == Block::Kind::bail) {
+                Bail(state);
+            } else if (Blocks[id].Type == Block::Kind::jump) {
+                const auto target{Blocks[id].Target};
+                Transfer(state, Blocks[target].St);
+                Emit("jmp", BlockLabel(target));
+            } else {
+                Walk(state);
+            }
+        }
+
+        if (not NeedGeneric) return vcai::move(Out);
+
+        // Остаточный код переходит в копию только из мест остановки
+        // специализации и рекурсивных вызовов
+        auto res{Copy()};
+        // Конец исходной программы - завершение работы
+        res.append("    jmp _pe_end\n");
+        res.append(Out);
+        res.append("_pe_end:\n");
+
+        return res;
+    }
+
+   private:
+    struct Val {
+        bool Known{};
+        i64 Value{};
+        // Значение записано в регистр/стек остаточной программы
+        bool Phys{};
+
+        [[nodiscard]] constexpr auto operator==(const Val &other) const noexcept
+            -> bool {
+            if (Known != other.Known) return false;
+            return not Known or (Value == other.Value and Phys == other.Phys);
+        }
+    };
+
+    // Неизвестные значения всегда находятся на своих местах в регистрах и
+    // стеке остаточной программы, известные - только при Phys
+    struct State {
+        StaticArray<Val, 4> IntReg{};
+        StaticArray<Val, 4> ArgReg{};
+        StaticArray<Val, STACKSIZE> Stack{};
+        // SP остаточной программы может отставать от SP
+        i64 SP{}, PhysSP{}, PC{};
+        Val ZF{}, SF{};
+        // Адреса возврата встроенных вызовов
+        DynamicArray<i64> CallStack;
+
+        [[nodiscard]] constexpr auto operator==(
+            const State &other) const noexcept -> bool {
+            if (PC != other.PC or SP != other.SP or PhysSP != other.PhysSP)
+                return false;
+            if (not(ZF == other.ZF) or not(SF == other.SF)) return false;
+            for (size reg{}; reg < 4; ++reg)
+                if (not(IntReg[reg] == other.IntReg[reg]) or
+                    not(ArgReg[reg] == other.ArgReg[reg]))
+                    return false;
+            for (size ind{}; ind < STACKSIZE; ++ind)
+                if (not(Stack[ind] == other.Stack[ind])) return false;
+            if (CallStack.size() != other.CallStack.size()) return false;
+            for (size ind{}; ind < CallStack.size(); ++ind)
+                if (CallStack[ind] != other.CallStack[ind]) return false;
+
+            return true;
+        }
+    };
+
+    struct Block {
+        // walk - специализация с состояния St, bail - переход в копию
+        // исходной программы, jump - запись значений и переход в блок Target
+        enum class Kind : unsigned char { walk, bail, jump };
+
+        State St;
+        Kind Type{};
+        size Target{};
+        // Первый блок с такими SP и CallStack на этом адресе
+        bool Root{};
+    };
+
+    // Аргумент инструкции в абстрактном состоянии
+    struct Ref {
+        enum class Kind : unsigned char { none, cell, sp, vr, imm };
+
+        Kind Type{};
+        Val *Cell{};
+        // Номер векторного регистра, значение константы или индекс в стеке
+        i64 Value{};
+        Operand Arg{};
+    };
+
+    // Блок для продолжения специализации, Fresh - блок только что создан
+    struct Choice {
+        size Id{};
+        bool Fresh{};
+    };
+
+    enum class Next : unsigned char { step, bail, split };
+    enum class Fold : unsigned char { ok, phys, bail };
+
+    static constexpr i64 I64MIN{-9223372036854775807 - 1};  // NOLINT
+
+    const Program *Prog;
+    State Init;
+    DynamicArray<Block> Blocks;
+    DynamicArray<size> Pending;
+    String Out;
+    // Адреса копии исходной программы, на которые есть переходы
+    DynamicArray<bool> Targets;
+    bool NeedGeneric{};
+    size Steps{}, Frames{};
+    i64 SplitTarget{};
+
+    [[nodiscard]] static constexpr auto Known(const KnownInput &known,
+                                              size reg) noexcept -> Val {
+        // I64MIN нельзя записать константой, такое значение остаётся
+        // неизвестным и берётся из Input. Остаточная программа получает тот
+        // же Input, поэтому известные значения уже записаны
+        if (known.Values.ArgReg[reg] == I64MIN) return {};
+        return {true, known.Values.ArgReg[reg], true};
+    }
+
+    [[nodiscard]] static constexpr auto BlockLabel(size id) noexcept
+        -> String {
+        String name{"_pe_s"};
+        name.append(to_string(static_cast<i64>(id)));
+        return name;
+    }
+
+    [[nodiscard]] static constexpr auto GenericLabel(i64 addr) noexcept
+        -> String {
+        String name{"_pe_g"};
+        name.append(to_string(addr));
+        return name;
+    }
+
+    [[nodiscard]] constexpr auto Generic(i64 addr) noexcept -> String {
+        while (Targets.size() <= Prog->Code.size()) Targets.push_back(false);
+        Targets[static_cast<size>(addr)] = true;
+        return GenericLabel(addr);
+    }
+
+    // Копия исходной программы с ярлыками _pe_g на адресах переходов. Адреса
+    // инструкций совпадают с исходными, поэтому адреса ярлыков в регистрах
+    // остаются верными
+    [[nodiscard]] constexpr auto Copy() noexcept -> String {
+        const auto prog_size{Prog->Code.size()};
+        for (size addr{}; addr < prog_size; ++addr) {
+            const auto &instr{Prog->Fetch(addr)};
+            for (size aind{}; aind < instr.Argc and aind < 3; ++aind)
+                if (instr.Args[aind].Type == Operand::Kind::label)
+                    static_cast<void>(Generic(instr.Args[aind].Value));
+        }
+
+        String res;
+        for (size addr{}; addr <= prog_size; ++addr) {
+            if (Targets[addr]) {
+                res.append(GenericLabel(static_cast<i64>(addr)));
+                res.append(":\n");
+            }
+            if (addr < prog_size) res.append(Serialize(Prog->Fetch(addr)));
+        }
+
+        return res;
+    }
+
+    [[nodiscard]] static constexpr auto RegName(char prefix, i64 reg) noexcept
+        -> String {
+        String name;
+        name.push_back(prefix);
+        name.push_back(static_cast<char>('0' + reg));
+        return name;
+    }
+
+    constexpr auto Emit(const char *func, const String &arg1 = {},
+                        const String &arg2 = {},
+                        const String &arg3 = {}) noexcept -> void {
+        Out.append("    ");
+        Out.append(func);
+        for (const auto *arg : StaticArray{&arg1, &arg2, &arg3}) {
+            if (arg->size() == 0) break;
+            Out.push_back(' ');
+            Out.append(*arg);
+        }
+        Out.push_back('\n');
+    }
+
+    constexpr auto Label(const String &name) noexcept -> void {
+        Out.append(name);
+        Out.append(":\n");
+    }
+
+    [[nodiscard]] constexpr auto Serialize(const Instr &instr) noexcept
+        -> String {
+        using Kind = Operand::Kind;
+
+        String line{"    "};
+        line.append(instr.Code == Op::none ? "?" : FUNCS[size(instr.Code)]);
+        for (size aind{}; aind < instr.Argc; ++aind) {
+            line.push_back(' ');
+            if (aind >= 3) {
+                line.push_back('?');
+                continue;
+            }
+
+            const auto &arg{instr.Args[aind]};
+            switch (arg.Type) {
+                case Kind::ir:
+                    line.append(RegName('r', arg.Value));
+                    break;
+                case Kind::ar:
+                    line.append(RegName('a', arg.Value));
+                    break;
+                case Kind::vr:
+                    line.append(RegName('v', arg.Value));
+                    break;
+                case Kind::sp:
+                    line.append("sp");
+                    break;
+                case Kind::stack_ir:
+                    line.push_back('&');
+                    line.append(RegName('r', arg.Value));
+                    break;
+                case Kind::stack_ar:
+                    line.push_back('&');
+                    line.append(RegName('a', arg.Value));
+                    break;
+                case Kind::label:
+                    line.append(GenericLabel(arg.Value));
+                    break;
+                case Kind::imm:
+                    line.append(to_string(arg.Value));
+                    break;
+                default:  // Неизвестное слово
+                    line.push_back('?');
+            }
+        }
+        line.push_back('\n');
+
+        return line;
+    }
+
+    // Запись известных значений в остаточную программу
+    constexpr auto SyncSP(State &st) noexcept -> void {
+        if (st.PhysSP != st.SP) {
+            Emit("mov", String{"sp"}, to_string(st.SP));
+            st.PhysSP = st.SP;
+        }
+    }
+
+    constexpr auto MaterializeReg(Val &cell, const String &name) noexcept
+        -> void {
+        if (cell.Known and not cell.Phys) {
+            Emit("mov", name, to_string(cell.Value));
+            cell.Phys = true;
+        }
+    }
+
+    constexpr auto MaterializeSlot(State &st, i64 ind) noexcept -> void {
+        auto &cell{st.Stack[static_cast<size>(ind)]};
+        if (cell.Known and not cell.Phys) {
+            // Без свободного регистра значение записывается через SP
+            if (st.PhysSP != ind) Emit("mov", String{"sp"}, to_string(ind));
+            Emit("push", to_string(cell.Value));
+            st.PhysSP = ind + 1;
+            cell.Phys = true;
+        }
+    }
+
+    constexpr auto MaterializeFlags(State &st) noexcept -> void {
+        if ((not st.ZF.Known or st.ZF.Phys) and (not st.SF.Known or st.SF.Phys))
+            return;
+
+        // SF известен только вместе с ZF, при ZF == 1 SF не влияет на переходы
+        if (st.SF.Known)
+            Emit("cmp", to_string(st.SF.Value != 0 ? 0 : 1),
+                 to_string(st.SF.Value != 0 ? 1 : 0));
+        if (st.ZF.Known and st.ZF.Value != 0)
+            Emit("cmp", String{"0"}, String{"0"});
+        st.ZF.Phys = st.SF.Phys = true;
+    }
+
+    // Стек, SP и регистры
+    constexpr auto MaterializeValues(State &st) noexcept -> void {
+        for (i64 ind{}; ind < st.SP; ++ind) MaterializeSlot(st, ind);
+        SyncSP(st);
+        for (size reg{}; reg < 4; ++reg) {
+            MaterializeReg(st.IntReg[reg], RegName('r', static_cast<i64>(reg)));
+            MaterializeReg(st.ArgReg[reg], RegName('a', static_cast<i64>(reg)));
+        }
+    }
+
+    constexpr auto MaterializeAll(State &st) noexcept -> void {
+        MaterializeValues(st);
+        MaterializeFlags(st);
+    }
+
+    // Продолжение выполнения в копии исходной программы
+    constexpr auto Bail(State &st) noexcept -> void {
+        NeedGeneric = true;
+        MaterializeAll(st);
+
+        // Восстановление CallStack встроенных вызовов: ret из функции вернётся
+        // на jmp к инструкции после исходного call
+        for (size frame{1}; frame < st.CallStack.size(); ++frame) {
+            String name{"_pe_f"};
+            name.append(to_string(static_cast<i64>(Frames++)));
+            Emit("call", name);
+            Emit("jmp", Generic(st.CallStack[frame] + 1));
+            Label(name);
+        }
+        Emit("jmp", Generic(st.PC));
+    }
+
+    // Функция addr уже выполняется в одном из встроенных вызовов
+    [[nodiscard]] constexpr auto Active(const State &st,
+                                        i64 addr) const noexcept -> bool {
+        for (size frame{1}; frame < st.CallStack.size(); ++frame) {
+            const auto &call{
+                Prog->Fetch(static_cast<size>(st.CallStack[frame]))};
+            if (call.Args[0].Type == Operand::Kind::label and
+                call.Args[0].Value == addr)
+                return true;
+        }
+
+        return false;
+    }
+
+    // Известны все регистры, от которых зависит вызов чистой функции
+    [[nodiscard]] static constexpr auto KnownArgs(const State &st,
+                                                  const Instr &instr) noexcept
+        -> bool {
+        const unsigned key{instr.MemoKey};
+        for (size reg{}; reg < 4; ++reg) {
+            if ((key >> reg & 1U) != 0 and not st.IntReg[reg].Known)
+                return false;
+            if ((key >> (reg + 4) & 1U) != 0 and not st.ArgReg[reg].Known)
+                return false;
+        }
+        if ((key >> 8U & 1U) != 0 and not st.ZF.Known)  // NOLINT magic numbers
+            return false;
+        return (key >> 9U & 1U) == 0 or st.SF.Known;  // NOLINT magic numbers
+    }
+
+    // Рекурсивный вызов чистой функции с неизвестными аргументами не
+    // встраивается, а выполняется копией исходной программы. Функция читает
+    // только регистры MemoKey, записывает только MemoOut и стек выше SP
+    constexpr auto Call(State &st, const Instr &instr, i64 addr) noexcept
+        -> void {
+        for (auto ind{st.SP}; ind < static_cast<i64>(STACKSIZE); ++ind)
+            MaterializeSlot(st, ind);
+        SyncSP(st);
+
+        const auto regs{static_cast<unsigned>(instr.MemoKey | instr.MemoOut)};
+        for (size reg{}; reg < 4; ++reg) {
+            const auto name{static_cast<i64>(reg)};
+            if ((regs >> reg & 1U) != 0)
+                MaterializeReg(st.IntReg[reg], RegName('r', name));
+            if ((regs >> (reg + 4) & 1U) != 0)
+                MaterializeReg(st.ArgReg[reg], RegName('a', name));
+        }
+        if ((regs >> 8U) != 0) MaterializeFlags(st);  // NOLINT magic numbers
+
+        NeedGeneric = true;
+        Emit("call", Generic(addr));
+
+        const unsigned out{instr.MemoOut};
+        for (size reg{}; reg < 4; ++reg) {
+            if ((out >> reg & 1U) != 0) st.IntReg[reg] = {};
+            if ((out >> (reg + 4) & 1U) != 0) st.ArgReg[reg] = {};
+        }
+        if ((out >> 8U & 1U) != 0) st.ZF = {};  // NOLINT magic numbers
+        if ((out >> 9U & 1U) != 0) st.SF = {};  // NOLINT magic numbers
+        for (auto ind{st.SP}; ind < static_cast<i64>(STACKSIZE); ++ind)
+            st.Stack[static_cast<size>(ind)] = {};
+    }
+
+    // ZF и SF после завершения программы не видны
+    constexpr auto Exit(State &st) noexcept -> void {
+        MaterializeValues(st);
+        Emit("ret");
+    }
+
+    [[nodiscard]] constexpr auto Resolve(State &st, const Operand &arg) noexcept
+        -> Ref {
+        using Kind = Operand::Kind;
+
+        const auto reg{static_cast<size>(arg.Value)};
+        switch (arg.Type) {
+            case Kind::ir:
+                return {Ref::Kind::cell, &st.IntReg[reg], 0, arg};
+            case Kind::ar:
+                return {Ref::Kind::cell, &st.ArgReg[reg], 0, arg};
+            case Kind::vr:
+                return {Ref::Kind::vr, nullptr, arg.Value, arg};
+            case Kind::sp:
+                return {Ref::Kind::sp, nullptr, 0, arg};
+            case Kind::stack_ir:
+            case Kind::stack_ar: {
+                const auto &index{arg.Type == Kind::stack_ir ? st.IntReg[reg]
+                                                             : st.ArgReg[reg]};
+                if (not index.Known or index.Value < 0 or index.Value >= st.SP)
+                    return {};
+                return {Ref::Kind::cell,
+                        &st.Stack[static_cast<size>(index.Value)], index.Value,
+                        arg};
+            }
+            case Kind::label:
+            case Kind::imm:
+                return {Ref::Kind::imm, nullptr, arg.Value, arg};
+            default:
+                return {};
+        }
+    }
+
+    [[nodiscard]] static constexpr auto IsStack(const Ref &ref) noexcept
+        -> bool {
+        return ref.Arg.Type == Operand::Kind::stack_ir or
+               ref.Arg.Type == Operand::Kind::stack_ar;
+    }
+
+    [[nodiscard]] static constexpr auto Get(const State &st,
+                                            const Ref &ref) noexcept -> Val {
+        switch (ref.Type) {
+            case Ref::Kind::cell:
+                return *ref.Cell;
+            case Ref::Kind::sp:
+                return {true, st.SP, true};
+            case Ref::Kind::imm:
+                return {true, ref.Value, true};
+            default:
+                return {};
+        }
+    }
+
+    // Аргумент в тексте остаточной программы
+    [[nodiscard]] constexpr auto Name(State &st, const Ref &ref) noexcept
+        -> String {
+        using Kind = Operand::Kind;
+
+        const auto &arg{ref.Arg};
+        switch (arg.Type) {
+            case Kind::ir:
+                return RegName('r', arg.Value);
+            case Kind::ar:
+                return RegName('a', arg.Value);
+            case Kind::vr:
+                return RegName('v', arg.Value);
+            case Kind::sp:
+                return String{"sp"};
+            case Kind::stack_ir:
+            case Kind::stack_ar: {
+                auto prefix{arg.Type == Kind::stack_ir ? 'r' : 'a'};
+                auto &index{arg.Type == Kind::stack_ir
+                                ? st.IntReg[static_cast<size>(arg.Value)]
+                                : st.ArgReg[static_cast<size>(arg.Value)]};
+                auto name{RegName(prefix, arg.Value)};
+                MaterializeReg(index, name);
+
+                String deref{"&"};
+                deref.append(name);
+                return deref;
+            }
+            default:
+                return to_string(ref.Value);
+        }
+    }
+
+    // Читаемый аргумент: известные значения подставляются константами
+    [[nodiscard]] constexpr auto Src(State &st, const Ref &ref) noexcept
+        -> String {
+        auto val{Get(st, ref)};
+        if (val.Known) return to_string(val.Value);
+        return Name(st, ref);
+    }
+
+    // Изменяемый аргумент: известное значение сначала записывается
+    [[nodiscard]] constexpr auto Own(State &st, const Ref &ref) noexcept
+        -> String {
+        if (ref.Type == Ref::Kind::cell) {
+            if (IsStack(ref))
+                MaterializeSlot(st, ref.Value);
+            else
+                MaterializeReg(*ref.Cell, Name(st, ref));
+        }
+        return Name(st, ref);
+    }
+
+    // false - значение нельзя сделать известным
+    [[nodiscard]] static constexpr auto SetKnown(State &st, const Ref &ref,
+                                                 i64 value) noexcept -> bool {
+        if (value == I64MIN) return false;
+
+        switch (ref.Type) {
+            case Ref::Kind::cell:
+                *ref.Cell = {true, value, false};
+                return true;
+            case Ref::Kind::sp:
+                st.SP = value;
+                return true;
+            case Ref::Kind::imm:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    static constexpr auto SetUnknown(const Ref &ref) noexcept -> void {
+        if (ref.Type == Ref::Kind::cell) *ref.Cell = {};
+    }
+
+    [[nodiscard]] static constexpr auto Calc(Op func, i64 lhs, i64 rhs,
+                                             i64 &res) noexcept -> Fold {
+        // Переполнение вычисляется так же, как на x86-64
+        const auto ulhs{static_cast<size>(lhs)}, urhs{static_cast<size>(rhs)};
+        switch (func) {
+            case Op::add:
+                res = static_cast<i64>(ulhs + urhs);
+                break;
+            case Op::sub:
+                res = static_cast<i64>(ulhs - urhs);
+                break;
+            case Op::mul:
+                res = static_cast<i64>(ulhs * urhs);
+                break;
+            case Op::div:
+            case Op::mod:
+                if (rhs == 0 or (lhs == I64MIN and rhs == -1))
+                    return Fold::bail;
+                res = func == Op::div ? lhs / rhs : lhs % rhs;
+                break;
+            case Op::shl:
+            case Op::shr:
+                if (rhs < 0 or rhs >= 64) return Fold::bail;  // NOLINT
+                res = func == Op::shl ? static_cast<i64>(ulhs << urhs)
+                                      : lhs >> rhs;  // NOLINT binary op
+                break;
+            case Op::v_xor:
+                res = lhs ^ rhs;  // NOLINT binary op on int
+                break;
+            case Op::v_and:
+                res = lhs & rhs;  // NOLINT binary op on int
+                break;
+            case Op::v_or:
+                res = lhs | rhs;  // NOLINT binary op on int
+                break;
+            default:
+                return Fold::bail;
+        }
+
+        return res == I64MIN ? Fold::phys : Fold::ok;
+    }
+
+    // Условие перехода: 0/1, -1 - неизвестно
+    [[nodiscard]] static constexpr auto Condition(Op func,
+                                                  const State &st) noexcept
+        -> int {
+        if (not st.ZF.Known) return -1;
+        if (st.ZF.Value != 0)
+            return func == Op::je or func == Op::jle or func == Op::jge ? 1 : 0;
+        if (func == Op::je) return 0;
+        if (func == Op::jne) return 1;
+        if (not st.SF.Known) return -1;
+
+        bool sf{st.SF.Value != 0};
+        if (func == Op::jl or func == Op::jle) return sf ? 1 : 0;
+        return sf ? 0 : 1;  // jg, jge
+    }
+
+    // Инструкция, выполняемая в остаточной программе
+    constexpr auto Residual(State &st, Op func, StaticArray<Ref, 3> &refs,
+                            size argc) noexcept -> Next {
+        auto &dst{refs[0]};
+        if (dst.Type == Ref::Kind::sp) return Next::bail;
+        if (dst.Type == Ref::Kind::imm) return Next::step;  // Нет эффекта
+
+        StaticArray<String, 3> args;
+        const bool reads{argc == 2 and func != Op::mov and func != Op::vsum};
+        bool stack{IsStack(dst)};
+        for (size aind{1}; aind < argc; ++aind) {
+            args[aind] = Src(st, refs[aind]);
+            stack = stack or IsStack(refs[aind]);
+        }
+
+        auto val{Get(st, dst)};
+        if (reads and val.Known and func <= Op::mod) {
+            // dst op= src <=> dst = dst op src
+            args[0] = Name(st, dst);
+            SyncSP(st);
+            Emit(FUNCS[size(func)], args[0], to_string(val.Value), args[1]);
+        } else {
+            if (reads or argc == 1)
+                args[0] = Own(st, dst);
+            else
+                args[0] = Name(st, dst);
+            if (stack) SyncSP(st);
+            Emit(FUNCS[size(func)], args[0], args[1], args[2]);
+        }
+        SetUnknown(dst);
+
+        return Next::step;
+    }
+
+    constexpr auto Scalar(State &st, Op func, StaticArray<Ref, 3> &refs,
+                          size argc) noexcept -> Next {
+        auto &dst{refs[0]};
+        i64 res{};
+        if (argc == 3) {
+            auto lhs{Get(st, refs[1])}, rhs{Get(st, refs[2])};
+            if (lhs.Known and rhs.Known) {
+                auto fold{Calc(func, lhs.Value, rhs.Value, res)};
+                if (fold == Fold::bail) return Next::bail;
+                if (fold == Fold::ok and SetKnown(st, dst, res))
+                    return Next::step;
+            }
+            return Residual(st, func, refs, argc);
+        }
+
+        auto &src{refs[1]};
+        auto lhs{Get(st, dst)}, rhs{Get(st, src)};
+        if (func == Op::mov) {
+            if (rhs.Known and SetKnown(st, dst, rhs.Value)) return Next::step;
+            return Residual(st, func, refs, argc);
+        }
+
+        // x ^ x и x - x не зависят от x
+        bool same{dst.Type == Ref::Kind::cell and dst.Cell == src.Cell};
+        if (same and (func == Op::v_xor or func == Op::sub) and
+            SetKnown(st, dst, 0))
+            return Next::step;
+
+        if (lhs.Known and rhs.Known) {
+            auto fold{Calc(func, lhs.Value, rhs.Value, res)};
+            if (fold == Fold::bail) return Next::bail;
+            if (fold == Fold::ok and SetKnown(st, dst, res)) return Next::step;
+        }
+        return Residual(st, func, refs, argc);
+    }
+
+    constexpr auto Vector(State &st, Op func, StaticArray<Ref, 3> &refs,
+                          size argc) noexcept -> Next {
+        using Kind = Ref::Kind;
+
+        auto &dst{refs[0]};
+        // Векторные регистры всегда неизвестны
+        if (func <= Op::vshr) {
+            for (size aind{}; aind < argc; ++aind)
+                if (refs[aind].Type != Kind::vr) return Next::bail;
+            Emit(FUNCS[size(func)], Name(st, refs[0]), Name(st, refs[1]),
+                 argc == 3 ? Name(st, refs[2]) : String{});
+            return Next::step;
+        }
+
+        if (func == Op::vbrd or func == Op::vsum) {
+            auto &vec{func == Op::vbrd ? dst : refs[1]};
+            if (vec.Type != Kind::vr) return Next::bail;
+            if (func == Op::vsum) return Residual(st, func, refs, argc);
+
+            auto src{Src(st, refs[1])};
+            if (IsStack(refs[1])) SyncSP(st);
+            Emit("vbrd", Name(st, dst), src);
+            return Next::step;
+        }
+
+        if (dst.Type != Kind::vr) return Next::bail;
+        if (func == Op::vld or func == Op::vst) {
+            auto ind{Get(st, refs[1])};
+            if (not ind.Known or ind.Value < 0 or
+                ind.Value + static_cast<i64>(VLANES) > st.SP)
+                return Next::bail;
+
+            for (size lane{}; lane < VLANES; ++lane) {
+                auto &cell{st.Stack[static_cast<size>(ind.Value) + lane]};
+                if (func == Op::vld)
+                    MaterializeSlot(st, ind.Value + static_cast<i64>(lane));
+                else
+                    cell = {};
+            }
+            SyncSP(st);
+            Emit(FUNCS[size(func)], Name(st, dst), to_string(ind.Value));
+            return Next::step;
+        }
+
+        // vpush, vpop
+        const auto lanes{static_cast<i64>(VLANES)};
+        if (func == Op::vpush ? st.SP + lanes > static_cast<i64>(STACKSIZE)
+                              : st.SP < lanes)
+            return Next::bail;
+
+        for (i64 lane{}; lane < lanes; ++lane) {
+            if (func == Op::vpush)
+                st.Stack[static_cast<size>(st.SP + lane)] = {};
+            else
+                MaterializeSlot(st, st.SP - lanes + lane);
+        }
+        SyncSP(st);
+        Emit(FUNCS[size(func)], Name(st, dst));
+        st.SP += func == Op::vpush ? lanes : -lanes;
+        st.PhysSP = st.SP;
+
+        return Next::step;
+    }
+
+    constexpr auto Exec(State &st, const Instr &instr) noexcept  // NOLINT
+        -> Next {
+        const auto func{instr.Code};
+        const auto argc{instr.Argc};
+        if (argc > 3) {  // Не выполняется
+            ++st.PC;
+            return Next::step;
+        }
+        if (argc == 0) {
+            if (func == Op::none) return Next::bail;
+            if (func == Op::ret) {
+                st.PC = st.CallStack.back();
+                st.CallStack.pop_back();
+            }
+            ++st.PC;
+            return Next::step;
+        }
+        if (not valid_argc(func, argc)) return Next::bail;
+
+        StaticArray<Ref, 3> refs{};
+        for (size aind{}; aind < argc; ++aind) {
+            refs[aind] = Resolve(st, instr.Args[aind]);
+            if (refs[aind].Type == Ref::Kind::none) return Next::bail;
+        }
+        auto &dst{refs[0]};
+
+        if (func >= Op::vadd and func <= Op::vpop) {
+            auto next{Vector(st, func, refs, argc)};
+            if (next == Next::step) ++st.PC;
+            return next;
+        }
+
+        if (func >= Op::jmp and func <= Op::call) {
+            auto target{Get(st, dst)};
+            if (not target.Known) return Next::bail;
+
+            if (func == Op::jmp) {
+                st.PC = target.Value;
+            } else if (func == Op::call) {
+                if (instr.MemoOut != 0 and not KnownArgs(st, instr) and
+                    Active(st, target.Value)) {
+                    Call(st, instr, target.Value);
+                    ++st.PC;
+                } else {
+                    st.CallStack.push_back(st.PC);
+                    st.PC = target.Value;
+                }
+            } else {
+                auto cond{Condition(func, st)};
+                if (cond == -1) {
+                    SplitTarget = target.Value;
+                    return Next::split;
+                }
+                st.PC = cond == 1 ? target.Value : st.PC + 1;
+            }
+            return Next::step;
+        }
+
+        Next next{Next::step};
+        switch (func) {
+            case Op::cmp: {
+                auto lhs{Get(st, dst)}, rhs{Get(st, refs[1])};
+                if (lhs.Known and rhs.Known) {
+                    // При равенстве SF не меняется
+                    st.ZF = {true, lhs.Value == rhs.Value ? 1 : 0, false};
+                    if (lhs.Value != rhs.Value)
+                        st.SF = {true, lhs.Value < rhs.Value ? 1 : 0, false};
+                    break;
+                }
+
+                auto args{StaticArray<String, 2>{Src(st, dst),
+                                                 Src(st, refs[1])}};
+                if (IsStack(dst) or IsStack(refs[1])) SyncSP(st);
+                Emit("cmp", args[0], args[1]);
+                st.ZF = st.SF = {};
+                break;
+            }
+            case Op::inc:
+            case Op::dec: {
+                auto val{Get(st, dst)};
+                if (val.Known and
+                    SetKnown(st, dst,
+                             static_cast<i64>(static_cast<size>(val.Value) +
+                                              (func == Op::inc ? 1 : -1))))
+                    break;
+                next = Residual(st, func, refs, argc);
+                break;
+            }
+            case Op::push: {
+                if (st.SP < 0 or st.SP >= static_cast<i64>(STACKSIZE))
+                    return Next::bail;
+
+                auto val{Get(st, dst)};
+                auto &slot{st.Stack[static_cast<size>(st.SP)]};
+                if (val.Known) {
+                    slot = {true, val.Value, false};
+                } else {
+                    auto src{Name(st, dst)};
+                    SyncSP(st);
+                    Emit("push", src);
+                    ++st.PhysSP;
+                    slot = {};
+                }
+                ++st.SP;
+                break;
+            }
+            case Op::pop: {
+                if (st.SP <= 0 or st.SP > static_cast<i64>(STACKSIZE))
+                    return Next::bail;
+
+                auto val{st.Stack[static_cast<size>(st.SP - 1)]};
+                if (val.Known) {
+                    --st.SP;
+                    // В векторный регистр значение записывается явно
+                    if (not SetKnown(st, dst, val.Value))
+                        Emit("mov", Name(st, dst), to_string(val.Value));
+                    break;
+                }
+
+                if (dst.Type == Ref::Kind::sp) return Next::bail;
+                if (dst.Type != Ref::Kind::imm) {
+                    auto name{Name(st, dst)};
+                    SyncSP(st);
+                    Emit("pop", name);
+                    --st.PhysSP;
+                    SetUnknown(dst);
+                }
+                --st.SP;
+                break;
+            }
+            default:
+                next = Scalar(st, func, refs, argc);
+        }
+
+        if (next == Next::step) ++st.PC;
+        return next;
+    }
+
+    [[nodiscard]] constexpr auto Find(const State &st) const noexcept -> i64 {
+        for (size id{}; id < Blocks.size(); ++id)
+            if (Blocks[id].Type != Block::Kind::jump and Blocks[id].St == st)
+                return static_cast<i64>(id);
+
+        return -1;
+    }
+
+    // Количество вариантов адреса с разными SP и CallStack
+    [[nodiscard]] constexpr auto Variants(i64 pc) const noexcept -> size {
+        size count{};
+        for (const auto &block : Blocks)
+            if (block.Root and block.St.PC == pc) ++count;
+
+        return count;
+    }
+
+    constexpr auto NewBlock(const State &st, Block::Kind type,
+                            size target = 0, bool root = false) noexcept
+        -> size {
+        Blocks.push_back({st, type, target, root});
+        return Blocks.size() - 1;
+    }
+
+    // В одно состояние можно перейти из другого, записав значения
+    [[nodiscard]] static constexpr auto SameShape(const State &lhs,
+                                                  const State &rhs) noexcept
+        -> bool {
+        if (lhs.PC != rhs.PC or lhs.SP != rhs.SP or lhs.PhysSP != rhs.PhysSP)
+            return false;
+        if (lhs.CallStack.size() != rhs.CallStack.size()) return false;
+        for (size ind{}; ind < lhs.CallStack.size(); ++ind)
+            if (lhs.CallStack[ind] != rhs.CallStack[ind]) return false;
+
+        return true;
+    }
+
+    // Значения, различающиеся в двух состояниях, становятся неизвестными
+    static constexpr auto Join(Val &cell, const Val &other) noexcept -> void {
+        if (cell.Known and (not other.Known or cell.Value != other.Value))
+            cell = {};
+    }
+
+    [[nodiscard]] static constexpr auto Join(const State &block,
+                                             const State &st) noexcept
+        -> State {
+        auto res{block};
+        for (size reg{}; reg < 4; ++reg) {
+            Join(res.IntReg[reg], st.IntReg[reg]);
+            Join(res.ArgReg[reg], st.ArgReg[reg]);
+        }
+        for (size ind{}; ind < STACKSIZE; ++ind)
+            Join(res.Stack[ind], st.Stack[ind]);
+        Join(res.ZF, st.ZF);
+        Join(res.SF, st.SF);
+
+        return res;
+    }
+
+    // Значение нужно записать перед переходом в блок с ячейкой target
+    [[nodiscard]] static constexpr auto Unwritten(const Val &cell,
+                                                  const Val &target) noexcept
+        -> bool {
+        return cell.Known and not cell.Phys and
+               (not target.Known or target.Phys);
+    }
+
+    [[nodiscard]] static constexpr auto NeedTransfer(
+        const State &st, const State &target) noexcept -> bool {
+        if (st.PhysSP != st.SP) return true;
+        if (Unwritten(st.ZF, target.ZF) or Unwritten(st.SF, target.SF))
+            return true;
+        for (size reg{}; reg < 4; ++reg)
+            if (Unwritten(st.IntReg[reg], target.IntReg[reg]) or
+                Unwritten(st.ArgReg[reg], target.ArgReg[reg]))
+                return true;
+        for (size ind{}; ind < STACKSIZE; ++ind)
+            if (Unwritten(st.Stack[ind], target.Stack[ind])) return true;
+
+        return false;
+    }
+
+    // Запись значений, которые блок target считает записанными или
+    // неизвестными
+    constexpr auto Transfer(State &st, const State &target) noexcept
+        -> void {
+        for (size ind{}; ind < STACKSIZE; ++ind)
+            if (Unwritten(st.Stack[ind], target.Stack[ind]))
+                MaterializeSlot(st, static_cast<i64>(ind));
+        SyncSP(st);
+        for (size reg{}; reg < 4; ++reg) {
+            const auto ind{static_cast<i64>(reg)};
+            if (Unwritten(st.IntReg[reg], target.IntReg[reg]))
+                MaterializeReg(st.IntReg[reg], RegName('r', ind));
+            if (Unwritten(st.ArgReg[reg], target.ArgReg[reg]))
+                MaterializeReg(st.ArgReg[reg], RegName('a', ind));
+        }
+        if (Unwritten(st.ZF, target.ZF) or Unwritten(st.SF, target.SF))
+            MaterializeFlags(st);
+    }
+
+    // Блок для продолжения с состояния st и признак нового блока. Адрес с
+    // теми же SP и CallStack специализируется для MAXVARIANTS разных
+    // известных значений (циклы с известными границами разворачиваются),
+    // после этого различия с последним вариантом становятся неизвестными
+    [[nodiscard]] constexpr auto Choose(const State &st) noexcept
+        -> Choice {
+        auto id{Find(st)};
+        if (id != -1) return {static_cast<size>(id), false};
+
+        size same{};
+        i64 last{-1};
+        for (size ind{}; ind < Blocks.size(); ++ind) {
+            if (Blocks[ind].Type == Block::Kind::walk and
+                SameShape(Blocks[ind].St, st)) {
+                ++same;
+                last = static_cast<i64>(ind);
+            }
+        }
+
+        if (same >= MAXVARIANTS) {
+            const auto ind{static_cast<size>(last)};
+            auto joined{Join(Blocks[ind].St, st)};
+            if (joined == Blocks[ind].St) return {ind, false};
+            id = Find(joined);
+            if (id != -1) return {static_cast<size>(id), false};
+            return {NewBlock(joined, Block::Kind::walk), true};
+        }
+
+        if (last == -1 and Variants(st.PC) >= MAXVARIANTS)
+            return {NewBlock(st, Block::Kind::bail), true};
+        return {NewBlock(st, Block::Kind::walk, 0, last == -1), true};
+    }
+
+    constexpr auto Walk(State &st) noexcept -> void {
+        const auto prog_size{static_cast<i64>(Prog->Code.size())};
+        while (true) {
+            if (st.PC < 0 or st.PC >= prog_size or st.CallStack.is_empty())
+                return Exit(st);
+            if (++Steps > MAXSTEPS) return Bail(st);
+
+            const auto &instr{Prog->Fetch(static_cast<size>(st.PC))};
+            auto next{Exec(st, instr)};
+            if (next == Next::bail) return Bail(st);
+            if (next == Next::step) continue;
+
+            // Неизвестное условие перехода - специализируются обе ветви
+            SyncSP(st);
+
+            auto taken{st};
+            taken.PC = SplitTarget;
+            auto [id, fresh]{Choose(taken)};
+            if (fresh) Pending.push_back(id);
+            if (NeedTransfer(taken, Blocks[id].St)) {
+                id = NewBlock(taken, Block::Kind::jump, id);
+                Pending.push_back(id);
+            }
+            Emit(FUNCS[size(instr.Code)], BlockLabel(id));
+
+            ++st.PC;
+            const auto [next_id, next_fresh]{Choose(st)};
+            auto target{Blocks[next_id].St};
+            Transfer(st, target);
+            if (not next_fresh) return Emit("jmp", BlockLabel(next_id));
+
+            Label(BlockLabel(next_id));
+            if (Blocks[next_id].Type == Block::Kind::bail) return Bail(st);
+            st = vcai::move(target);
+        }
+    }
+};
+
+[[nodiscard]] constexpr auto specialize(const Program &prog,
+                                        const KnownInput &known) noexcept
+    -> String {
+    Specializer spec{prog, known};
+    return spec.Run();
+}
+
+[[nodiscard]] constexpr auto specialize(const char *txt,
+                                        const KnownInput &known) noexcept
+    -> String {
+    Program prog{txt};
+    return specialize(prog, known);
+}
+
+// Совпадение результатов исходной и остаточной программ (кроме Steps)
+[[nodiscard]] constexpr auto check_residual(const Program &prog,
+                                            const Program &residual,
+                                            const Input &input) noexcept
+    -> bool {
+    const auto lhs{exec_full(prog, input)}, rhs{exec_full(residual, input)};
+    if (lhs.SP != rhs.SP) return false;
+
+    for (size reg{}; reg < 4; ++reg) {
+        if (lhs.IntReg[reg] != rhs.IntReg[reg]) return false;
+        if (lhs.ArgReg[reg] != rhs.ArgReg[reg]) return false;
+        for (size lane{}; lane < VLANES; ++lane)
+            if (lhs.VecReg[reg][lane] != rhs.VecReg[reg][lane]) return false;
+    }
+    for (size ind{}; ind < STACKSIZE; ++ind)
+        if (lhs.Stack[ind] != rhs.Stack[ind]) return false;
+
+    return true;
 }
 
 }  // namespace vcai
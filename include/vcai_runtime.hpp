@@ -0,0 +1,245 @@
+#pragma once
+
+// Дополнения для рантайма, использующие стандартную библиотеку C++.
+// В отличие от vcai.hpp, не предназначены для constexpr-контекста
+
+#include <cstdio>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "vcai.hpp"
+
+namespace vcai {
+
+// Текстовый вывод трассировки, по одному событию на строку
+inline auto dump_trace(const Trace &trace, std::FILE *out = stdout) -> void {
+    if (trace.dropped() > 0)
+        std::fprintf(out, "# вытеснено событий: %lu\n", trace.dropped());
+
+    for (size ind{}; ind < trace.size(); ++ind) {
+        const auto &event{trace[ind]};
+        std::fprintf(out, "%6u %*s%-5s dst=%ld zf=%d sf=%d\n", event.PC,
+                     static_cast<int>(event.Depth) * 2, "",
+                     event.Opcode < FUNCS.size() ? FUNCS[event.Opcode] : "?",
+                     event.Dst,
+                     (event.Flags & TraceEvent::ZFBIT) != 0,
+                     (event.Flags & TraceEvent::SFBIT) != 0);
+    }
+}
+
+// Бинарный формат: общее количество событий (size), затем сохранённые
+// события от самого старого к самому новому (TraceEvent)
+inline auto write_trace(const Trace &trace, std::FILE *out) -> bool {
+    if (std::fwrite(&trace.Count, sizeof(trace.Count), 1, out) != 1)
+        return false;
+
+    for (size ind{}; ind < trace.size(); ++ind)
+        if (std::fwrite(&trace[ind], sizeof(TraceEvent), 1, out) != 1)
+            return false;
+
+    return true;
+}
+
+inline auto read_trace(std::FILE *in, Trace &trace) -> bool {
+    trace = Trace{};
+    if (std::fread(&trace.Count, sizeof(trace.Count), 1, in) != 1)
+        return false;
+
+    for (size ind{}; ind < trace.size(); ++ind) {
+        auto &event{trace.Events[(trace.dropped() + ind) % TRACESIZE]};
+        if (std::fread(&event, sizeof(TraceEvent), 1, in) != 1) return false;
+    }
+
+    return true;
+}
+
+inline auto print_trace_stats(const TraceStats &stats,
+                              std::FILE *out = stdout) -> void {
+    // NOLINTNEXTLINE magic numbers
+    constexpr size MAXLOOPS{10};
+    std::fprintf(out, "Горячие циклы (переход -> начало: выполнено раз):\n");
+    for (size ind{}; ind < stats.Loops.size() and ind < MAXLOOPS; ++ind)
+        std::fprintf(out, "  %ld -> %ld: %lu\n", stats.Loops[ind].From,
+                     stats.Loops[ind].To, stats.Loops[ind].Count);
+
+    std::fprintf(out, "Условные переходы (адрес: выполнен/всего):\n");
+    for (const auto &branch : stats.Branches)
+        std::fprintf(out, "  %ld: %lu/%lu (%.1f%%)\n", branch.PC, branch.Taken,
+                     branch.Total,
+                     100.0 * static_cast<double>(branch.Taken) /  // NOLINT
+                         static_cast<double>(branch.Total));
+
+    std::fprintf(out, "Глубина CallStack (глубина: инструкций):\n");
+    for (size depth{}; depth < stats.Depths.size(); ++depth)
+        if (stats.Depths[depth] > 0)
+            std::fprintf(out, "  %lu: %lu\n", depth, stats.Depths[depth]);
+}
+
+// Потокобезопасный кэш загруженных программ, ключ - текст программы.
+// При переполнении вытесняется программа, к которой дольше всего не обращались
+class ProgramCache {
+   public:
+    struct Stats {
+        vcai::size Hits, Misses, Evictions;
+    };
+
+    explicit ProgramCache(vcai::size capacity) : m_capacity(capacity) {}
+
+    // Загружает программу при первом обращении. Возвращаемая программа
+    // остаётся действительной и после вытеснения из кэша
+    auto get(const char *txt) -> std::shared_ptr<const Program> {
+        const std::string_view key{txt};
+        {
+            std::lock_guard lock{m_mutex};
+            if (auto prog{Find(key)}) {
+                ++m_stats.Hits;
+                return prog;
+            }
+            ++m_stats.Misses;
+        }
+
+        // Загрузка без блокировки, чтобы не задерживать другие потоки
+        std::shared_ptr<const Program> prog{std::make_shared<Program>(txt)};
+
+        std::lock_guard lock{m_mutex};
+        // Другой поток мог успеть загрузить ту же программу
+        if (auto loaded{Find(key)}) return loaded;
+
+        m_entries.push_front({std::string{key}, prog});
+        m_index.emplace(m_entries.front().Text, m_entries.begin());
+        while (m_entries.size() > m_capacity) {
+            m_index.erase(m_entries.back().Text);
+            m_entries.pop_back();
+            ++m_stats.Evictions;
+        }
+
+        return prog;
+    }
+
+    [[nodiscard]] auto stats() const -> Stats {
+        std::lock_guard lock{m_mutex};
+        return m_stats;
+    }
+
+    [[nodiscard]] auto size() const -> vcai::size {
+        std::lock_guard lock{m_mutex};
+        return m_entries.size();
+    }
+
+    auto clear() -> void {
+        std::lock_guard lock{m_mutex};
+        m_index.clear();
+        m_entries.clear();
+    }
+
+   private:
+    struct Entry {
+        std::string Text;
+        std::shared_ptr<const Program> Prog;
+    };
+
+    // Вызывается под m_mutex
+    auto Find(std::string_view key) -> std::shared_ptr<const Program> {
+        auto found{m_index.find(key)};
+        if (found == m_index.end()) return nullptr;
+
+        // Программа становится последней использованной
+        m_entries.splice(m_entries.begin(), m_entries, found->second);
+        return found->second->Prog;
+    }
+
+    mutable std::mutex m_mutex;
+    // От последних использованных к давно не использованным
+    std::list<Entry> m_entries;
+    // Ключи ссылаются на Entry::Text в m_entries
+    std::unordered_map<std::string_view, std::list<Entry>::iterator> m_index;
+    vcai::size m_capacity;
+    Stats m_stats{};
+};
+
+// Параллельная загрузка больших программ: текст делится на части по границам
+// строк, части разбираются на слова и декодируются в threads потоках.
+// Результат совпадает с Program::Load(), prog должна быть пустой
+inline auto load_parallel(
+    Program &prog, const char *txt,
+    unsigned threads = std::thread::hardware_concurrency()) -> void {
+    // Меньшие программы быстрее загрузить в одном потоке
+    constexpr size MINPART{1 << 16};  // NOLINT magic numbers
+
+    const auto len{vcai::strlen(txt)};
+    size count{threads > 0 ? threads : 1};
+    if (len / count < MINPART) count = len / MINPART;
+    if (count <= 1) {
+        prog.Load(txt);
+        return;
+    }
+
+    struct Part {
+        size Begin, Len;
+        DynamicArray<DynamicArray<String>> Words;
+        // Ярлыки и main с адресами относительно начала части
+        Program Local;
+        // Адрес первой строки части в программе
+        size Offset;
+    };
+    std::vector<Part> parts(count);
+
+    size begin{};
+    for (auto &part : parts) {
+        auto end{begin + len / count < len ? begin + len / count : len};
+        while (end < len and txt[end - 1] != '\n') ++end;
+        if (&part == &parts.back()) end = len;
+
+        part.Begin = begin;
+        part.Len = end - begin;
+        begin = end;
+    }
+
+    auto parallel_for = [&parts](auto &&func) {
+        std::vector<std::thread> workers;
+        for (size ind{1}; ind < parts.size(); ++ind)
+            workers.emplace_back(func, ind);
+        func(0);
+        for (auto &worker : workers) worker.join();
+    };
+
+    parallel_for([&](size ind) {
+        auto &part{parts[ind]};
+        part.Local.ToWordArray(txt + part.Begin, part.Len, part.Words);
+    });
+
+    // Объединение ярлыков в порядке частей: при повторах, как и в Load(),
+    // find() находит первый ярлык, а main - последний
+    size total{};
+    for (auto &part : parts) {
+        part.Offset = total;
+        auto &labels{part.Local.Labels};
+        for (size ind{}; ind < labels.size(); ++ind)
+            prog.Labels.push_back(
+                vcai::move(labels.keys[ind]),
+                static_cast<i64>(part.Offset) + labels.values[ind]);
+        if (part.Local.Entry != -1)
+            prog.Entry = static_cast<i64>(part.Offset) + part.Local.Entry;
+
+        total += part.Words.size();
+    }
+
+    prog.Code.reserve(total);
+    for (size ind{}; ind < total; ++ind) prog.Code.push_back(Instr{});
+
+    // Ярлыки известны, части декодируются независимо
+    parallel_for([&](size ind) {
+        const auto &part{parts[ind]};
+        for (size line{}; line < part.Words.size(); ++line)
+            prog.Code[part.Offset + line] = prog.Decode(part.Words[line]);
+    });
+    prog.AnalyzeCalls();
+}
+
+}  // namespace vcai